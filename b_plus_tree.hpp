@@ -0,0 +1,667 @@
+#ifndef SIMPLELIB_B_PLUS_TREE_HPP_
+#define SIMPLELIB_B_PLUS_TREE_HPP_
+
+#include <new>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "common.h"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//In-node search of BPlusTree over the sorted keys[0, n):
+//    count_less          number of keys less than k
+//    count_not_greater   number of keys not greater than k
+//kLanes is the number of keys compared at once, node capacities are rounded
+//down to a multiple of it so that vector loads never leave the key array.
+//The generic version does a binary search with Comp.
+template <typename Key, typename Comp>
+struct BPlusTreeSearch {
+    static constexpr std::size_t kLanes = 1;
+
+    static std::size_t count_less(const Key *keys, std::size_t n, const Key &k, const Comp &comp) {
+        return std::lower_bound(keys, keys + n, k, comp) - keys;
+    }
+
+    static std::size_t count_not_greater(const Key *keys, std::size_t n, const Key &k,
+                                         const Comp &comp) {
+        return std::upper_bound(keys, keys + n, k, comp) - keys;
+    }
+};
+
+//32-bit signed keys: 8 lanes with AVX2, 4 lanes with SSE2
+template <>
+struct BPlusTreeSearch<int32_t, std::less<int32_t>> {
+    static constexpr std::size_t kLanes = 8;
+
+    //Keys are sorted, so the lanes matching "key < k" form a prefix
+    static std::size_t count_less(const int32_t *keys, std::size_t n, int32_t k,
+                                  const std::less<int32_t> &) {
+        std::size_t ret = 0;
+#if defined(__AVX2__)
+        __m256i target = _mm256_set1_epi32(k);
+        for (std::size_t i = 0; i < n; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+            uint32_t mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(target, v)));
+            ret += __builtin_popcount(mask & valid_mask(n - i, 8));
+            if (mask != 0xFF) {
+                break;
+            }
+        }
+#elif defined(__SSE2__)
+        __m128i target = _mm_set1_epi32(k);
+        for (std::size_t i = 0; i < n; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+            uint32_t mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(target, v)));
+            ret += __builtin_popcount(mask & valid_mask(n - i, 4));
+            if (mask != 0xF) {
+                break;
+            }
+        }
+#else
+        while (ret < n && keys[ret] < k) {
+            ret++;
+        }
+#endif
+        return ret;
+    }
+
+    static std::size_t count_not_greater(const int32_t *keys, std::size_t n, int32_t k,
+                                         const std::less<int32_t> &comp) {
+        //key <= k is key < k + 1, unless k + 1 overflows
+        if (k == INT32_MAX) {
+            return n;
+        }
+        return count_less(keys, n, k + 1, comp);
+    }
+
+    static uint32_t valid_mask(std::size_t remain, std::size_t lanes) {
+        return remain >= lanes ? (1u << lanes) - 1 : (1u << remain) - 1;
+    }
+};
+
+//64-bit signed keys: 4 lanes with AVX2, 2 lanes with SSE4.2
+template <>
+struct BPlusTreeSearch<int64_t, std::less<int64_t>> {
+    static constexpr std::size_t kLanes = 4;
+
+    static std::size_t count_less(const int64_t *keys, std::size_t n, int64_t k,
+                                  const std::less<int64_t> &) {
+        std::size_t ret = 0;
+#if defined(__AVX2__)
+        __m256i target = _mm256_set1_epi64x(k);
+        for (std::size_t i = 0; i < n; i += 4) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+            uint32_t mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(target, v)));
+            ret += __builtin_popcount(mask & valid_mask(n - i, 4));
+            if (mask != 0xF) {
+                break;
+            }
+        }
+#elif defined(__SSE4_2__)
+        __m128i target = _mm_set1_epi64x(k);
+        for (std::size_t i = 0; i < n; i += 2) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+            uint32_t mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(target, v)));
+            ret += __builtin_popcount(mask & valid_mask(n - i, 2));
+            if (mask != 0x3) {
+                break;
+            }
+        }
+#else
+        while (ret < n && keys[ret] < k) {
+            ret++;
+        }
+#endif
+        return ret;
+    }
+
+    static std::size_t count_not_greater(const int64_t *keys, std::size_t n, int64_t k,
+                                         const std::less<int64_t> &comp) {
+        if (k == INT64_MAX) {
+            return n;
+        }
+        return count_less(keys, n, k + 1, comp);
+    }
+
+    static uint32_t valid_mask(std::size_t remain, std::size_t lanes) {
+        return remain >= lanes ? (1u << lanes) - 1 : (1u << remain) - 1;
+    }
+};
+
+//A B+ tree with the same interface as RedBlackTree (tree_insert, tree_find,
+//tree_delete, tree_size, tree_clear, find, range), for read heavy workloads:
+//    1.Nodes are about NODE_SIZE bytes and aligned to cache lines, so a few
+//      lines cover the whole node instead of one miss per level
+//    2.In-node search compares several keys at once with SSE/AVX2 for
+//      int32_t/int64_t keys under std::less, see BPlusTreeSearch
+//    3.Leaves are linked in key order for range scans
+//Build with -mavx2 (or -march=native) to get the AVX2 paths.
+//Key and Value must be default constructible and assignable; values move
+//around on insertion and deletion, so find() results are only valid until
+//the next modification.
+template <typename Key, typename Value, typename Comp = std::less<Key>,
+          std::size_t NODE_SIZE = 256>
+class BPlusTree {
+private:
+//************************* Internal structures ******************************
+
+    typedef BPlusTreeSearch<Key, Comp> Search;
+
+    static constexpr std::size_t kCacheLine = 64;
+    static constexpr std::size_t kMaxDepth = 48;
+
+    static_assert(NODE_SIZE % kCacheLine == 0, "NODE_SIZE must be a multiple of cache lines");
+
+    static constexpr std::size_t slots(std::size_t room, std::size_t slot_size) {
+        return std::max<std::size_t>(4, room / slot_size / Search::kLanes * Search::kLanes);
+    }
+
+    //Header 8 bytes, plus n keys and n + 1 children
+    static constexpr std::size_t kInnerSlots = slots(NODE_SIZE - 16, sizeof(Key) + sizeof(void *));
+    //Header 8 bytes, plus n keys, n values and two sibling links
+    static constexpr std::size_t kLeafSlots = slots(NODE_SIZE - 24, sizeof(Key) + sizeof(Value));
+    static constexpr std::size_t kMinInner = kInnerSlots / 2;
+    static constexpr std::size_t kMinLeaf = kLeafSlots / 2;
+
+    static_assert(kInnerSlots % Search::kLanes == 0 && kLeafSlots % Search::kLanes == 0,
+                  "Vector loads must stay inside the key arrays");
+
+    struct Node {
+        explicit Node(bool leaf) : _leaf(leaf) {}
+
+        uint32_t _count = 0;
+        bool _leaf;
+    };
+
+    //Child i holds the keys in [_keys[i - 1], _keys[i])
+    struct alignas(kCacheLine) Inner : public Node {
+        Inner() : Node(false) {}
+
+        Key _keys[kInnerSlots];
+        Node *_children[kInnerSlots + 1];
+    };
+
+    struct alignas(kCacheLine) Leaf : public Node {
+        Leaf() : Node(true) {}
+
+        Key _keys[kLeafSlots];
+        Value _values[kLeafSlots];
+        Leaf *_prev = nullptr;
+        Leaf *_next = nullptr;
+    };
+
+    //One step of a root to leaf walk: the inner node and the child taken
+    struct Step {
+        Inner *_node;
+        std::size_t _idx;
+    };
+
+//*************************** Node management ********************************
+
+    //Plain new does not honor over-aligned types before C++17
+    template <typename T>
+    static T * create_node() {
+        void *mem = nullptr;
+        if (posix_memalign(&mem, kCacheLine, sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return new(mem) T();
+    }
+
+    template <typename T>
+    static void destroy_node(T *node) {
+        node->~T();
+        free(node);
+    }
+
+    void inner_destroy(Node *node) {
+        if (node->_leaf) {
+            destroy_node(static_cast<Leaf *>(node));
+            return;
+        }
+        Inner *inner = static_cast<Inner *>(node);
+        for (std::size_t i = 0; i <= inner->_count; i++) {
+            inner_destroy(inner->_children[i]);
+        }
+        destroy_node(inner);
+    }
+
+//******************************* Finder *************************************
+
+    //Walk down to the leaf which should hold k, recording the steps if asked
+    Leaf * find_leaf(const Key &k, Step *path = nullptr, std::size_t *depth = nullptr) {
+        Node *node = _root;
+        std::size_t d = 0;
+        while (!node->_leaf) {
+            Inner *inner = static_cast<Inner *>(node);
+            std::size_t idx = Search::count_not_greater(inner->_keys, inner->_count, k, _comp);
+            if (path != nullptr) {
+                path[d]._node = inner;
+                path[d]._idx = idx;
+            }
+            d++;
+            node = inner->_children[idx];
+        }
+        if (depth != nullptr) {
+            *depth = d;
+        }
+        return static_cast<Leaf *>(node);
+    }
+
+//***************************** Insertion ************************************
+
+    //Put key and child at key position idx, child goes right of the key
+    void insert_at(Inner *inner, std::size_t idx, Key &&key, Node *child) {
+        std::move_backward(inner->_keys + idx, inner->_keys + inner->_count,
+                           inner->_keys + inner->_count + 1);
+        std::move_backward(inner->_children + idx + 1, inner->_children + inner->_count + 1,
+                           inner->_children + inner->_count + 2);
+        inner->_keys[idx] = std::move(key);
+        inner->_children[idx + 1] = child;
+        inner->_count++;
+    }
+
+    //Insert key/child into a full inner node, the upper half goes to sibling
+    //and the middle key is moved out into *key
+    void split_inner(Inner *inner, std::size_t idx, Key *key, Node *child, Inner *sibling) {
+        Key keys[kInnerSlots + 1];
+        Node *children[kInnerSlots + 2];
+        std::move(inner->_keys, inner->_keys + idx, keys);
+        keys[idx] = std::move(*key);
+        std::move(inner->_keys + idx, inner->_keys + kInnerSlots, keys + idx + 1);
+        std::copy(inner->_children, inner->_children + idx + 1, children);
+        children[idx + 1] = child;
+        std::copy(inner->_children + idx + 1, inner->_children + kInnerSlots + 1, children + idx + 2);
+
+        std::size_t mid = (kInnerSlots + 1) / 2;
+        std::move(keys, keys + mid, inner->_keys);
+        std::copy(children, children + mid + 1, inner->_children);
+        inner->_count = mid;
+
+        *key = std::move(keys[mid]);
+
+        std::move(keys + mid + 1, keys + kInnerSlots + 1, sibling->_keys);
+        std::copy(children + mid + 1, children + kInnerSlots + 2, sibling->_children);
+        sibling->_count = kInnerSlots - mid;
+    }
+
+    template <typename K, typename V>
+    void insert_into_leaf(Leaf *leaf, std::size_t pos, K &&k, V &&v) {
+        std::move_backward(leaf->_keys + pos, leaf->_keys + leaf->_count,
+                           leaf->_keys + leaf->_count + 1);
+        std::move_backward(leaf->_values + pos, leaf->_values + leaf->_count,
+                           leaf->_values + leaf->_count + 1);
+        leaf->_keys[pos] = std::forward<K>(k);
+        leaf->_values[pos] = std::forward<V>(v);
+        leaf->_count++;
+    }
+
+    template <typename K, typename V>
+    bool inner_insert(K &&k, V &&v) {
+        if (_root == nullptr) {
+            _root = create_node<Leaf>();
+        }
+
+        Step path[kMaxDepth];
+        std::size_t depth = 0;
+        Leaf *leaf = find_leaf(k, path, &depth);
+        std::size_t pos = Search::count_less(leaf->_keys, leaf->_count, k, _comp);
+        if (pos < leaf->_count && !_comp(k, leaf->_keys[pos])) {
+            return false;
+        }
+        _size++;
+
+        if (leaf->_count < kLeafSlots) {
+            insert_into_leaf(leaf, pos, std::forward<K>(k), std::forward<V>(v));
+            return true;
+        }
+
+        //Split the full leaf, both halves hold at least kMinLeaf keys
+        Leaf *right = create_node<Leaf>();
+        std::size_t left_count = (kLeafSlots + 1) / 2;
+        std::size_t from = pos < left_count ? left_count - 1 : left_count;
+        std::move(leaf->_keys + from, leaf->_keys + kLeafSlots, right->_keys);
+        std::move(leaf->_values + from, leaf->_values + kLeafSlots, right->_values);
+        right->_count = kLeafSlots - from;
+        leaf->_count = from;
+        if (pos < left_count) {
+            insert_into_leaf(leaf, pos, std::forward<K>(k), std::forward<V>(v));
+        } else {
+            insert_into_leaf(right, pos - left_count, std::forward<K>(k), std::forward<V>(v));
+        }
+
+        right->_next = leaf->_next;
+        if (right->_next != nullptr) {
+            right->_next->_prev = right;
+        }
+        right->_prev = leaf;
+        leaf->_next = right;
+
+        //Push the separator up, splitting full inner nodes on the way
+        Key separator = right->_keys[0];
+        Node *child = right;
+        while (depth > 0) {
+            depth--;
+            Inner *inner = path[depth]._node;
+            if (inner->_count < kInnerSlots) {
+                insert_at(inner, path[depth]._idx, std::move(separator), child);
+                return true;
+            }
+            Inner *sibling = create_node<Inner>();
+            split_inner(inner, path[depth]._idx, &separator, child, sibling);
+            child = sibling;
+        }
+
+        Inner *root = create_node<Inner>();
+        root->_keys[0] = std::move(separator);
+        root->_children[0] = _root;
+        root->_children[1] = child;
+        root->_count = 1;
+        _root = root;
+        return true;
+    }
+
+//******************************* Deletion ***********************************
+
+    //Remove the key at idx and the child right of it
+    void remove_at(Inner *inner, std::size_t idx) {
+        std::move(inner->_keys + idx + 1, inner->_keys + inner->_count, inner->_keys + idx);
+        std::copy(inner->_children + idx + 2, inner->_children + inner->_count + 1,
+                  inner->_children + idx + 1);
+        inner->_count--;
+    }
+
+    //Refill an underflowed leaf from a sibling under the same parent, or merge
+    void rebalance_leaf(Leaf *leaf, Step *path, std::size_t depth) {
+        if (depth == 0) {
+            if (leaf->_count == 0) {
+                destroy_node(leaf);
+                _root = nullptr;
+            }
+            return;
+        }
+        if (leaf->_count >= kMinLeaf) {
+            return;
+        }
+
+        Inner *parent = path[depth - 1]._node;
+        std::size_t idx = path[depth - 1]._idx;
+        Leaf *left = idx > 0 ? static_cast<Leaf *>(parent->_children[idx - 1]) : nullptr;
+        Leaf *right = idx < parent->_count ? static_cast<Leaf *>(parent->_children[idx + 1]) : nullptr;
+
+        if (left != nullptr && left->_count > kMinLeaf) {
+            insert_into_leaf(leaf, 0, std::move(left->_keys[left->_count - 1]),
+                             std::move(left->_values[left->_count - 1]));
+            left->_count--;
+            parent->_keys[idx - 1] = leaf->_keys[0];
+            return;
+        }
+
+        if (right != nullptr && right->_count > kMinLeaf) {
+            leaf->_keys[leaf->_count] = std::move(right->_keys[0]);
+            leaf->_values[leaf->_count] = std::move(right->_values[0]);
+            leaf->_count++;
+            std::move(right->_keys + 1, right->_keys + right->_count, right->_keys);
+            std::move(right->_values + 1, right->_values + right->_count, right->_values);
+            right->_count--;
+            parent->_keys[idx] = right->_keys[0];
+            return;
+        }
+
+        //Merge the right one of the pair into the left one
+        if (left == nullptr) {
+            left = leaf;
+            leaf = right;
+            idx++;
+        }
+        std::move(leaf->_keys, leaf->_keys + leaf->_count, left->_keys + left->_count);
+        std::move(leaf->_values, leaf->_values + leaf->_count, left->_values + left->_count);
+        left->_count += leaf->_count;
+        left->_next = leaf->_next;
+        if (left->_next != nullptr) {
+            left->_next->_prev = left;
+        }
+        destroy_node(leaf);
+        remove_at(parent, idx - 1);
+
+        rebalance_inner(path, depth - 1);
+    }
+
+    //Same as rebalance_leaf for path[depth]._node, keys rotate through the parent
+    void rebalance_inner(Step *path, std::size_t depth) {
+        Inner *node = path[depth]._node;
+        if (depth == 0) {
+            if (node->_count == 0) {
+                _root = node->_children[0];
+                destroy_node(node);
+            }
+            return;
+        }
+        if (node->_count >= kMinInner) {
+            return;
+        }
+
+        Inner *parent = path[depth - 1]._node;
+        std::size_t idx = path[depth - 1]._idx;
+        Inner *left = idx > 0 ? static_cast<Inner *>(parent->_children[idx - 1]) : nullptr;
+        Inner *right = idx < parent->_count ? static_cast<Inner *>(parent->_children[idx + 1]) : nullptr;
+
+        if (left != nullptr && left->_count > kMinInner) {
+            std::move_backward(node->_keys, node->_keys + node->_count,
+                               node->_keys + node->_count + 1);
+            std::move_backward(node->_children, node->_children + node->_count + 1,
+                               node->_children + node->_count + 2);
+            node->_keys[0] = std::move(parent->_keys[idx - 1]);
+            node->_children[0] = left->_children[left->_count];
+            node->_count++;
+            parent->_keys[idx - 1] = std::move(left->_keys[left->_count - 1]);
+            left->_count--;
+            return;
+        }
+
+        if (right != nullptr && right->_count > kMinInner) {
+            node->_keys[node->_count] = std::move(parent->_keys[idx]);
+            node->_children[node->_count + 1] = right->_children[0];
+            node->_count++;
+            parent->_keys[idx] = std::move(right->_keys[0]);
+            std::move(right->_keys + 1, right->_keys + right->_count, right->_keys);
+            std::copy(right->_children + 1, right->_children + right->_count + 1, right->_children);
+            right->_count--;
+            return;
+        }
+
+        if (left == nullptr) {
+            left = node;
+            node = right;
+            idx++;
+        }
+        left->_keys[left->_count] = std::move(parent->_keys[idx - 1]);
+        std::move(node->_keys, node->_keys + node->_count, left->_keys + left->_count + 1);
+        std::copy(node->_children, node->_children + node->_count + 1,
+                  left->_children + left->_count + 1);
+        left->_count += node->_count + 1;
+        destroy_node(node);
+        remove_at(parent, idx - 1);
+
+        rebalance_inner(path, depth - 1);
+    }
+
+#ifdef UNIT_TEST
+    //Check ordering, occupancy and leaf depth of the subtree, keys must be in
+    //[lo, hi) where null means unbounded. Returns the leaf depth or -1.
+    int inner_check(Node *node, const Key *lo, const Key *hi, bool is_root, Leaf **prev) {
+        std::size_t min = node->_leaf ? kMinLeaf : kMinInner;
+        if (node->_count == 0 || (!is_root && node->_count < min)) {
+            return -1;
+        }
+        const Key *keys = node->_leaf ? static_cast<Leaf *>(node)->_keys
+                                      : static_cast<Inner *>(node)->_keys;
+        for (std::size_t i = 0; i < node->_count; i++) {
+            if ((i > 0 && !_comp(keys[i - 1], keys[i])) ||
+                (lo != nullptr && _comp(keys[i], *lo)) ||
+                (hi != nullptr && !_comp(keys[i], *hi))) {
+                return -1;
+            }
+        }
+
+        if (node->_leaf) {
+            Leaf *leaf = static_cast<Leaf *>(node);
+            if (leaf->_prev != *prev || (*prev != nullptr && (*prev)->_next != leaf)) {
+                return -1;
+            }
+            *prev = leaf;
+            return 0;
+        }
+
+        Inner *inner = static_cast<Inner *>(node);
+        int depth = -1;
+        for (std::size_t i = 0; i <= inner->_count; i++) {
+            const Key *child_lo = i == 0 ? lo : &inner->_keys[i - 1];
+            const Key *child_hi = i == inner->_count ? hi : &inner->_keys[i];
+            int d = inner_check(inner->_children[i], child_lo, child_hi, false, prev);
+            if (d < 0 || (depth >= 0 && d != depth)) {
+                return -1;
+            }
+            depth = d;
+        }
+        return depth + 1;
+    }
+#endif
+
+//****************************** Data area ***********************************
+    Comp _comp = Comp();
+    Node *_root = nullptr;
+    uint32_t _size = 0;
+
+public:
+//****************** Constructors and Deconstructor **************************
+
+    BPlusTree() = default;
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    virtual ~BPlusTree() {
+        tree_clear();
+    }
+
+//***************************** Interfaces ***********************************
+
+    bool tree_insert(const Key& k, const Value& v) {
+        return inner_insert(k, v);
+    }
+
+    bool tree_insert(Key&& k, Value&& v) {
+        return inner_insert(std::move(k), std::move(v));
+    }
+
+    bool tree_delete(const Key& k) {
+        if (_root == nullptr) {
+            return false;
+        }
+
+        Step path[kMaxDepth];
+        std::size_t depth = 0;
+        Leaf *leaf = find_leaf(k, path, &depth);
+        std::size_t pos = Search::count_less(leaf->_keys, leaf->_count, k, _comp);
+        if (pos == leaf->_count || _comp(k, leaf->_keys[pos])) {
+            return false;
+        }
+
+        //Separators above may still hold k, they stay valid bounds
+        std::move(leaf->_keys + pos + 1, leaf->_keys + leaf->_count, leaf->_keys + pos);
+        std::move(leaf->_values + pos + 1, leaf->_values + leaf->_count, leaf->_values + pos);
+        leaf->_count--;
+        _size--;
+
+        rebalance_leaf(leaf, path, depth);
+        return true;
+    }
+
+    bool tree_find(const Key& k, Value *v) {
+        Value *target = find(k);
+        if (target == nullptr) {
+            return false;
+        }
+
+        *v = *target;
+        return true;
+    }
+
+    //Return the value of k in place, or nullptr if k does not exist.
+    //The pointer is valid until the next modification.
+    Value * find(const Key& k) {
+        if (_root == nullptr) {
+            return nullptr;
+        }
+
+        Leaf *leaf = find_leaf(k);
+        std::size_t pos = Search::count_less(leaf->_keys, leaf->_count, k, _comp);
+        if (pos == leaf->_count || _comp(k, leaf->_keys[pos])) {
+            return nullptr;
+        }
+        return &leaf->_values[pos];
+    }
+
+    //Visit every key in [lo, hi) in order with visitor(const Key&, Value&)
+    //following the leaf links. Returns the number of keys visited.
+    template <typename Visitor>
+    std::size_t range(const Key &lo, const Key &hi, Visitor visitor) {
+        if (_root == nullptr) {
+            return 0;
+        }
+
+        std::size_t count = 0;
+        Leaf *leaf = find_leaf(lo);
+        std::size_t pos = Search::count_less(leaf->_keys, leaf->_count, lo, _comp);
+        while (leaf != nullptr) {
+            for (; pos < leaf->_count; pos++) {
+                if (!_comp(leaf->_keys[pos], hi)) {
+                    return count;
+                }
+                visitor(leaf->_keys[pos], leaf->_values[pos]);
+                count++;
+            }
+            leaf = leaf->_next;
+            pos = 0;
+        }
+        return count;
+    }
+
+    void tree_clear() {
+        if (_root != nullptr) {
+            inner_destroy(_root);
+        }
+        _root = nullptr;
+        _size = 0;
+    }
+
+    uint32_t tree_size() {
+        return _size;
+    }
+
+#ifdef UNIT_TEST
+    bool check_balanced() {
+        if (_root == nullptr) {
+            return _size == 0;
+        }
+        Leaf *last = nullptr;
+        if (inner_check(_root, nullptr, nullptr, true, &last) < 0) {
+            return false;
+        }
+        return last->_next == nullptr;
+    }
+#endif
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif  //SIMPLELIB_B_PLUS_TREE_HPP_
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 noet: */
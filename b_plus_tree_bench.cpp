@@ -0,0 +1,159 @@
+#include <map>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include "red_black_tree.hpp"
+#include "b_plus_tree.hpp"
+
+using namespace simplelib;
+
+//Run func once and return the elapsed wall time in milliseconds
+template <typename Func>
+double time_ms(Func func) {
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+//std::map adapted to the tree interface
+template <typename Key>
+class StdMap : public std::map<Key, Key> {
+public:
+    bool tree_insert(Key k, Key v) {
+        return this->emplace(k, v).second;
+    }
+
+    bool tree_find(Key k, Key *v) {
+        auto it = this->find(k);
+        if (it == this->end()) {
+            return false;
+        }
+        *v = it->second;
+        return true;
+    }
+
+    bool tree_delete(Key k) {
+        return this->erase(k) == 1;
+    }
+};
+
+//Random insert, find hits, find misses, then delete
+template <typename Tree, typename Key>
+void bench_tree(const char *name, const std::vector<Key> &keys, const std::vector<Key> &misses) {
+    Tree tree;
+    double insert = time_ms([&]() {
+        for (Key k : keys) {
+            tree.tree_insert(k, k);
+        }
+    });
+
+    Key sum = 0;
+    double hit = time_ms([&]() {
+        Key v = 0;
+        for (Key k : keys) {
+            if (tree.tree_find(k, &v)) {
+                sum += v;
+            }
+        }
+    });
+
+    double miss = time_ms([&]() {
+        Key v = 0;
+        for (Key k : misses) {
+            if (tree.tree_find(k, &v)) {
+                sum += v;
+            }
+        }
+    });
+
+    double erase = time_ms([&]() {
+        for (Key k : keys) {
+            tree.tree_delete(k);
+        }
+    });
+
+    double mops = keys.size() / 1000.0;
+    printf("%-16s insert %6.2f Mops/s  find hit %6.2f Mops/s  find miss %6.2f Mops/s"
+           "  delete %6.2f Mops/s%s\n",
+           name, mops / insert, mops / hit, mops / miss, mops / erase, sum == 0 ? " !" : "");
+}
+
+//Even keys are stored and odd keys miss, both shuffled
+template <typename Key>
+void make_keys(size_t n, std::vector<Key> *keys, std::vector<Key> *misses) {
+    keys->resize(n);
+    misses->resize(n);
+    for (size_t i = 0; i < n; i++) {
+        (*keys)[i] = static_cast<Key>(2 * i);
+        (*misses)[i] = static_cast<Key>(2 * i + 1);
+    }
+    std::shuffle(keys->begin(), keys->end(), std::default_random_engine(2021));
+    std::shuffle(misses->begin(), misses->end(), std::default_random_engine(2022));
+}
+
+template <typename Key>
+void bench_all(const char *title, size_t n) {
+    std::vector<Key> keys;
+    std::vector<Key> misses;
+    make_keys(n, &keys, &misses);
+
+    printf("== %s: %zu random keys ==\n", title, n);
+    bench_tree<StdMap<Key>>("std::map", keys, misses);
+    bench_tree<RedBlackTree<Key, Key>>("red black tree", keys, misses);
+    bench_tree<RedBlackTree<Key, Key, std::less<Key>, PoolNodeAllocator>>("rbt node pool", keys, misses);
+    bench_tree<BPlusTree<Key, Key>>("b+ tree", keys, misses);
+    bench_tree<BPlusTree<Key, Key, std::less<Key>, 512>>("b+ tree 512B", keys, misses);
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+#if defined(__AVX2__)
+    printf("In-node search: AVX2\n");
+#elif defined(__SSE4_2__)
+    printf("In-node search: SSE4.2 (int64 SSE, int32 SSE2)\n");
+#elif defined(__SSE2__)
+    printf("In-node search: SSE2 (int32 only)\n");
+#else
+    printf("In-node search: scalar\n");
+#endif
+
+    bench_all<int32_t>("int32_t", n);
+    bench_all<int64_t>("int64_t", n);
+
+    //Range scans: leaf links vs in-order iterator
+    std::vector<int64_t> keys;
+    std::vector<int64_t> misses;
+    make_keys(n, &keys, &misses);
+    BPlusTree<int64_t, int64_t> bpt;
+    RedBlackTree<int64_t, int64_t> rbt;
+    for (int64_t k : keys) {
+        bpt.tree_insert(k, k);
+        rbt.tree_insert(k, k);
+    }
+
+    int64_t sum = 0;
+    auto visitor = [&sum](const int64_t &, int64_t &v) { sum += v; };
+    int rounds = 10;
+    double bpt_scan = time_ms([&]() {
+        for (int r = 0; r < rounds; r++) {
+            bpt.range(INT64_MIN, INT64_MAX, visitor);
+        }
+    });
+    double rbt_scan = time_ms([&]() {
+        for (int r = 0; r < rounds; r++) {
+            rbt.range(INT64_MIN, INT64_MAX, visitor);
+        }
+    });
+    double mops = n * rounds / 1000.0;
+    printf("== Full scan: %zu keys x %d ==\n", n, rounds);
+    printf("%-16s %8.2f Mkeys/s\n%-16s %8.2f Mkeys/s%s\n", "b+ tree", mops / bpt_scan,
+           "red black tree", mops / rbt_scan, sum == 0 ? " !" : "");
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "gtest/gtest.h"
+#include "b_plus_tree.hpp"
+
+using namespace simplelib;
+
+//Random inserts and deletes checked against std::map
+template <typename Tree, typename Key, typename MakeKey>
+void random_ops(Tree *tree, int key_range, MakeKey make_key) {
+    std::map<Key, int> oracle;
+    std::default_random_engine engine(2021);
+    std::uniform_int_distribution<int> key_dist(-key_range, key_range);
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 50000; i++) {
+            Key k = make_key(key_dist(engine));
+            if (engine() % 3 == 0) {
+                ASSERT_EQ(oracle.erase(k) == 1, tree->tree_delete(k));
+            } else {
+                bool inserted = oracle.emplace(k, i).second;
+                ASSERT_EQ(inserted, tree->tree_insert(k, i));
+            }
+            if (i % 1000 == 0) {
+                ASSERT_TRUE(tree->check_balanced());
+                ASSERT_EQ(oracle.size(), tree->tree_size());
+            }
+        }
+        for (int k = -key_range; k <= key_range; k++) {
+            int *v = tree->find(make_key(k));
+            auto it = oracle.find(make_key(k));
+            ASSERT_EQ(it != oracle.end(), v != nullptr);
+            if (v != nullptr) {
+                ASSERT_EQ(it->second, *v);
+            }
+        }
+
+        //Drain half of the keys in order to exercise merges up to the root
+        std::vector<Key> keys;
+        for (auto &kv : oracle) {
+            keys.push_back(kv.first);
+        }
+        for (size_t i = 0; i < keys.size(); i += 2) {
+            ASSERT_TRUE(tree->tree_delete(keys[i]));
+            oracle.erase(keys[i]);
+        }
+        ASSERT_TRUE(tree->check_balanced());
+        ASSERT_EQ(oracle.size(), tree->tree_size());
+
+        tree->tree_clear();
+        oracle.clear();
+        ASSERT_EQ(0, tree->tree_size());
+        ASSERT_TRUE(tree->check_balanced());
+    }
+}
+
+TEST(BPlusTreeTest, Test_Random_Ops_Int64) {
+    BPlusTree<int64_t, int> tree;
+    random_ops<BPlusTree<int64_t, int>, int64_t>(&tree, 3000, [](int k) {
+        return static_cast<int64_t>(k) * 1000003;
+    });
+}
+
+TEST(BPlusTreeTest, Test_Random_Ops_Int32) {
+    BPlusTree<int32_t, int> tree;
+    random_ops<BPlusTree<int32_t, int>, int32_t>(&tree, 3000, [](int k) {
+        return k;
+    });
+}
+
+TEST(BPlusTreeTest, Test_Random_Ops_Generic) {
+    BPlusTree<std::string, int> tree;
+    random_ops<BPlusTree<std::string, int>, std::string>(&tree, 1000, [](int k) {
+        return std::to_string(k);
+    });
+}
+
+TEST(BPlusTreeTest, Test_Extreme_Keys) {
+    BPlusTree<int64_t, int> tree;
+    ASSERT_TRUE(tree.tree_insert(INT64_MAX, 1));
+    ASSERT_TRUE(tree.tree_insert(INT64_MIN, 2));
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(tree.tree_insert(INT64_MAX - 1 - i, i));
+    }
+    ASSERT_FALSE(tree.tree_insert(INT64_MAX, 3));
+    int v = 0;
+    ASSERT_TRUE(tree.tree_find(INT64_MAX, &v));
+    ASSERT_EQ(1, v);
+    ASSERT_TRUE(tree.tree_find(INT64_MIN, &v));
+    ASSERT_EQ(2, v);
+    ASSERT_TRUE(tree.check_balanced());
+}
+
+TEST(BPlusTreeTest, Test_Range) {
+    BPlusTree<int32_t, int> tree;
+    for (int i = 0; i < 10000; i += 2) {
+        ASSERT_TRUE(tree.tree_insert(i, i * 10));
+    }
+
+    std::vector<int> seen;
+    size_t n = tree.range(101, 1001, [&seen](const int32_t &k, int &v) {
+        ASSERT_EQ(k * 10, v);
+        seen.push_back(k);
+    });
+    ASSERT_EQ(450, n);
+    ASSERT_EQ(450, seen.size());
+    for (size_t i = 0; i < seen.size(); i++) {
+        ASSERT_EQ(102 + 2 * static_cast<int>(i), seen[i]);
+    }
+
+    ASSERT_EQ(5000, tree.range(-1, 20000, [](const int32_t &, int &) {}));
+    ASSERT_EQ(0, tree.range(500, 500, [](const int32_t &, int &) {}));
+    ASSERT_EQ(0, tree.range(20000, 30000, [](const int32_t &, int &) {}));
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    // Runs all tests using Google Test.
+    return RUN_ALL_TESTS();
+}
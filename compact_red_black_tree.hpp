@@ -0,0 +1,445 @@
+#ifndef SIMPLELIB_COMPACT_RED_BLACK_TREE_HPP_
+#define SIMPLELIB_COMPACT_RED_BLACK_TREE_HPP_
+
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <functional>
+#include "common.h"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//The compact red-black tree, same algorithm as RedBlackTree with a smaller node:
+//    1.Nodes live in one array and are addressed by 32-bit indexes,
+//      so it holds at most 2^31 - 1 nodes
+//    2.The color is packed into the lowest bit of the parent index
+//    3.The sentinel is slot 0 of the array, embedded in the tree
+//    4.Freed slots are chained into a free list and reused
+//For int/int a node takes 20 bytes, against 32 for RedBlackTree.
+//Growing the array moves the nodes, so the pointers returned by find() are
+//only valid until the next insertion. Call reserve() to avoid the moves.
+template <typename Key, typename Value, typename Comp = std::less<Key>>
+class CompactRedBlackTree {
+private:
+//************************* Internal structures ******************************
+
+    typedef uint32_t Index;
+
+    static constexpr Index kSentinel = 0;
+    static constexpr Index kMaxSize = std::numeric_limits<Index>::max() >> 1;
+
+    enum class Color : uint32_t { BLACK = 0, RED = 1 };
+
+    struct Node {
+        //Default constructor used by sentinel
+        Node() = default;
+
+        //Constructor used by insert node, the value is constructed from args
+        template <typename K, typename ...Args>
+        explicit Node(K &&key, Args&&... args)
+            : _k(std::forward<K>(key)), _v(std::forward<Args>(args)...),
+              _parent_color(static_cast<uint32_t>(Color::RED)) {}
+
+        //Data area
+        Key _k = Key();
+        Value _v = Value();
+        Index _left = kSentinel;         //Also the next slot of the free list
+        Index _right = kSentinel;
+        uint32_t _parent_color = static_cast<uint32_t>(Color::BLACK);
+    };
+
+    Node & node(Index i) {
+        return _nodes[i];
+    }
+
+    Index parent(Index i) {
+        return _nodes[i]._parent_color >> 1;
+    }
+
+    void set_parent(Index i, Index parent) {
+        _nodes[i]._parent_color = (parent << 1) | (_nodes[i]._parent_color & 1);
+    }
+
+    Color color(Index i) {
+        return static_cast<Color>(_nodes[i]._parent_color & 1);
+    }
+
+    void set_color(Index i, Color c) {
+        _nodes[i]._parent_color = (_nodes[i]._parent_color & ~1u) | static_cast<uint32_t>(c);
+    }
+
+//***************************** Slot management ******************************
+
+    template <typename K, typename ...Args>
+    Index create(K &&k, Args&&... args) {
+        if (_free != kSentinel) {
+            Index i = _free;
+            _free = _nodes[i]._left;
+            _nodes[i] = Node(std::forward<K>(k), std::forward<Args>(args)...);
+            return i;
+        }
+        _nodes.emplace_back(std::forward<K>(k), std::forward<Args>(args)...);
+        return static_cast<Index>(_nodes.size() - 1);
+    }
+
+    //Drop the payload right away and chain the slot into the free list
+    void destroy(Index i) {
+        _nodes[i] = Node();
+        _nodes[i]._left = _free;
+        _free = i;
+    }
+
+//******************************* Rotations **********************************
+
+    //See RedBlackTree::left_rotate
+    void left_rotate(Index x) {
+        Index temp = node(x)._right;
+        node(x)._right = node(temp)._left;
+        if (node(temp)._left != kSentinel) {
+            set_parent(node(temp)._left, x);
+        }
+        set_parent(temp, parent(x));
+        if (parent(x) == kSentinel) {
+            _root = temp;
+        } else if (x == node(parent(x))._left) {
+            node(parent(x))._left = temp;
+        } else {
+            node(parent(x))._right = temp;
+        }
+        node(temp)._left = x;
+        set_parent(x, temp);
+    }
+
+    //See RedBlackTree::right_rotate
+    void right_rotate(Index x) {
+        Index temp = node(x)._left;
+        node(x)._left = node(temp)._right;
+        if (node(temp)._right != kSentinel) {
+            set_parent(node(temp)._right, x);
+        }
+        set_parent(temp, parent(x));
+        if (parent(x) == kSentinel) {
+            _root = temp;
+        } else if (x == node(parent(x))._left) {
+            node(parent(x))._left = temp;
+        } else {
+            node(parent(x))._right = temp;
+        }
+        node(temp)._right = x;
+        set_parent(x, temp);
+    }
+
+//***************************** Insertion ************************************
+
+    //See RedBlackTree::insert_fixup for the cases
+    void insert_fixup(Index x) {
+        while (color(parent(x)) == Color::RED) {
+            Index grand = parent(parent(x));
+            if (parent(x) == node(grand)._left) {
+                Index temp = node(grand)._right;
+                if (color(temp) == Color::RED) {              //case 1
+                    set_color(parent(x), Color::BLACK);
+                    set_color(temp, Color::BLACK);
+                    set_color(grand, Color::RED);
+                    x = grand;
+                } else {
+                    if (x == node(parent(x))._right) {        //case 2
+                        x = parent(x);
+                        left_rotate(x);
+                    }
+                    set_color(parent(x), Color::BLACK);       //case 3
+                    set_color(parent(parent(x)), Color::RED);
+                    right_rotate(parent(parent(x)));
+                }
+            } else {
+                Index temp = node(grand)._left;
+                if (color(temp) == Color::RED) {              //case 4
+                    set_color(parent(x), Color::BLACK);
+                    set_color(temp, Color::BLACK);
+                    set_color(grand, Color::RED);
+                    x = grand;
+                } else {
+                    if (x == node(parent(x))._left) {         //case 5
+                        x = parent(x);
+                        right_rotate(x);
+                    }
+                    set_color(parent(x), Color::BLACK);       //case 6
+                    set_color(parent(parent(x)), Color::RED);
+                    left_rotate(parent(parent(x)));
+                }
+            }
+        }
+        set_color(_root, Color::BLACK);
+    }
+
+    void inner_insert(Index x, Index parent_index) {
+        if (parent_index == kSentinel) {
+            _root = x;
+        } else if (_comp(node(x)._k, node(parent_index)._k)) {
+            node(parent_index)._left = x;
+        } else {
+            node(parent_index)._right = x;
+        }
+        set_parent(x, parent_index);
+        insert_fixup(x);
+    }
+
+//******************************* Finder *************************************
+
+    //Return the index of k, or kSentinel with *parent_index set to the
+    //position for insertion
+    Index inner_find(const Key &k, Index *parent_index = nullptr) {
+        Index temp = _root;
+        Index last = kSentinel;
+        while (temp != kSentinel) {
+            const Node &n = node(temp);
+            if (_comp(k, n._k)) {
+                last = temp;
+                temp = n._left;
+            } else if (_comp(n._k, k)) {
+                last = temp;
+                temp = n._right;
+            } else {
+                return temp;
+            }
+        }
+        if (parent_index != nullptr) {
+            *parent_index = last;
+        }
+        return kSentinel;
+    }
+
+//******************************* Deletion ***********************************
+
+    Index minimum(Index x) {
+        while (node(x)._left != kSentinel) {
+            x = node(x)._left;
+        }
+        return x;
+    }
+
+    //See RedBlackTree::delete_fixup for the cases
+    void delete_fixup(Index x, Index p) {
+        while (x != _root && color(x) == Color::BLACK) {
+            if (x == node(p)._left) {
+                Index temp = node(p)._right;
+                if (color(temp) == Color::RED) {                        //case 1
+                    set_color(temp, Color::BLACK);
+                    set_color(p, Color::RED);
+                    left_rotate(p);
+                    temp = node(p)._right;
+                }
+                if (color(node(temp)._left) == Color::BLACK &&
+                    color(node(temp)._right) == Color::BLACK) {         //case 2
+                    set_color(temp, Color::RED);
+                    x = p;
+                    p = parent(x);
+                } else {
+                    if (color(node(temp)._right) == Color::BLACK) {     //case 3
+                        set_color(node(temp)._left, Color::BLACK);
+                        set_color(temp, Color::RED);
+                        right_rotate(temp);
+                        temp = node(p)._right;
+                    }
+                    set_color(temp, color(p));                          //case 4
+                    set_color(p, Color::BLACK);
+                    set_color(node(temp)._right, Color::BLACK);
+                    left_rotate(p);
+                    x = _root;
+                }
+            } else {
+                Index temp = node(p)._left;
+                if (color(temp) == Color::RED) {                        //case 5
+                    set_color(temp, Color::BLACK);
+                    set_color(p, Color::RED);
+                    right_rotate(p);
+                    temp = node(p)._left;
+                }
+                if (color(node(temp)._left) == Color::BLACK &&
+                    color(node(temp)._right) == Color::BLACK) {         //case 6
+                    set_color(temp, Color::RED);
+                    x = p;
+                    p = parent(x);
+                } else {
+                    if (color(node(temp)._left) == Color::BLACK) {      //case 7
+                        set_color(node(temp)._right, Color::BLACK);
+                        set_color(temp, Color::RED);
+                        left_rotate(temp);
+                        temp = node(p)._left;
+                    }
+                    set_color(temp, color(p));                          //case 8
+                    set_color(p, Color::BLACK);
+                    set_color(node(temp)._left, Color::BLACK);
+                    right_rotate(p);
+                    x = _root;
+                }
+            }
+        }
+        set_color(x, Color::BLACK);
+    }
+
+    void transplant(Index u, Index v) {
+        if (parent(u) == kSentinel) {
+            _root = v;
+        } else if (u == node(parent(u))._left) {
+            node(parent(u))._left = v;
+        } else {
+            node(parent(u))._right = v;
+        }
+        set_parent(v, parent(u));
+    }
+
+    //See RedBlackTree::inner_delete, the successor is relinked, not copied
+    void inner_delete(Index x) {
+        Index p = x;
+        Color removed = color(p);
+        Index q = kSentinel;
+        Index q_parent = parent(x);
+        if (node(x)._left == kSentinel) {
+            q = node(x)._right;
+            transplant(x, q);
+        } else if (node(x)._right == kSentinel) {
+            q = node(x)._left;
+            transplant(x, q);
+        } else {
+            p = minimum(node(x)._right);
+            removed = color(p);
+            q = node(p)._right;
+            if (parent(p) == x) {
+                q_parent = p;
+            } else {
+                q_parent = parent(p);
+                transplant(p, q);
+                node(p)._right = node(x)._right;
+                set_parent(node(p)._right, p);
+            }
+            transplant(x, p);
+            node(p)._left = node(x)._left;
+            set_parent(node(p)._left, p);
+            set_color(p, color(x));
+        }
+
+        if (removed == Color::BLACK) {
+            delete_fixup(q, q_parent);
+        }
+
+        destroy(x);
+    }
+
+#ifdef UNIT_TEST
+    //Black height of the subtree, -1 if unbalanced or a red node has a red child
+    int inner_check_balance(Index x) {
+        if (x == kSentinel) {
+            return 0;
+        }
+        if (color(x) == Color::RED &&
+            (color(node(x)._left) == Color::RED || color(node(x)._right) == Color::RED)) {
+            return -1;
+        }
+        int left = inner_check_balance(node(x)._left);
+        int right = inner_check_balance(node(x)._right);
+        if (left < 0 || right < 0 || left != right) {
+            return -1;
+        }
+        return left + (color(x) == Color::BLACK ? 1 : 0);
+    }
+#endif
+
+//****************************** Data area ***********************************
+    Comp _comp = Comp();
+    std::vector<Node> _nodes = std::vector<Node>(1);    //_nodes[0] is the sentinel
+    Index _root = kSentinel;
+    Index _free = kSentinel;
+    uint32_t _size = 0;
+
+public:
+//****************** Constructors and Deconstructor **************************
+
+    CompactRedBlackTree() = default;
+
+    virtual ~CompactRedBlackTree() = default;
+
+//***************************** Interfaces ***********************************
+
+    bool tree_insert(const Key& k, const Value& v) {
+        return try_emplace(k, v);
+    }
+
+    bool tree_insert(Key&& k, Value&& v) {
+        return try_emplace(std::move(k), std::move(v));
+    }
+
+    //Insert k with a value constructed from args, nothing is constructed
+    //if k exists. Fails as well when the tree is full.
+    template <typename K, typename ...Args>
+    bool try_emplace(K&& k, Args&&... args) {
+        Index parent_index = kSentinel;
+        if (inner_find(k, &parent_index) != kSentinel || _size >= kMaxSize) {
+            return false;
+        }
+
+        inner_insert(create(std::forward<K>(k), std::forward<Args>(args)...), parent_index);
+        _size++;
+
+        return true;
+    }
+
+    bool tree_delete(const Key& k) {
+        Index target = inner_find(k);
+        if (target == kSentinel) {
+            return false;
+        }
+
+        inner_delete(target);
+        _size--;
+
+        return true;
+    }
+
+    bool tree_find(const Key& k, Value *v) {
+        Value *target = find(k);
+        if (target == nullptr) {
+            return false;
+        }
+
+        *v = *target;
+        return true;
+    }
+
+    //Return the value of k in place, or nullptr if k does not exist.
+    //The pointer is valid until the next insertion.
+    Value * find(const Key& k) {
+        Index target = inner_find(k);
+        return target == kSentinel ? nullptr : &node(target)._v;
+    }
+
+    void tree_clear() {
+        _nodes.clear();
+        _nodes.emplace_back();
+        _root = kSentinel;
+        _free = kSentinel;
+        _size = 0;
+    }
+
+    //Make room for n nodes in total, so insertions do not move the array
+    void reserve(std::size_t n) {
+        _nodes.reserve(n + 1);
+    }
+
+    uint32_t tree_size() {
+        return _size;
+    }
+
+#ifdef UNIT_TEST
+    bool check_balanced() {
+        return color(_root) == Color::BLACK && inner_check_balance(_root) >= 0;
+    }
+#endif
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif  //SIMPLELIB_COMPACT_RED_BLACK_TREE_HPP_
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 noet: */
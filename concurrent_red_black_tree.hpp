@@ -0,0 +1,302 @@
+#ifndef SIMPLELIB_CONCURRENT_RED_BLACK_TREE_HPP_
+#define SIMPLELIB_CONCURRENT_RED_BLACK_TREE_HPP_
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include "common.h"
+#include "red_black_tree.hpp"
+
+//The optimistic walk races with RedBlackTree's writes on purpose, see try_find
+#if defined(__GNUC__) || defined(__clang__)
+#define CRBT_NO_SANITIZE_THREAD __attribute__((no_sanitize("thread")))
+#else
+#define CRBT_NO_SANITIZE_THREAD
+#endif
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//Node data of the tree inside ConcurrentRedBlackTree: a sequence counter
+//guarding the value alone, so tree_update() does not disturb other readers.
+//No bookkeeping on rotations.
+struct ConcurrentRedBlackTreeValueSeq {
+    template <typename Key>
+    struct NodeBase {
+        uint32_t _value_seq = 0;
+    };
+
+    static constexpr bool kEnabled = false;
+
+    template <typename Node>
+    static void update(Node *, const Node *) {}
+};
+
+//A thread safe RedBlackTree for read mostly workloads.
+//Writers serialize on a mutex. Readers take no lock: they walk the tree
+//optimistically and retry if it changed under them, so readers never block
+//each other and scale with cores as long as writes are rare.
+//
+//Inserting or deleting a key is bracketed by one tree wide sequence counter,
+//which is odd while a change is in progress. Any such write makes every
+//reader in flight retry, not only the readers whose search path it rotated:
+//there are no per node versions of the links. Those would have to be bumped
+//on every node a rotation or transplant relinks and on the whole path from a
+//relinked successor up to the deleted node, and survive the pool handing a
+//freed node out again. tree_update() only rewrites a value, under a per node
+//counter that only readers of that key check. Writes which change nothing
+//(existing key on insert, missing key on delete or update) count nothing.
+//
+//A reader may see a half updated tree, which is safe because:
+//    1.Nodes come from a PoolNodeAllocator, whose memory stays nodes until
+//      the tree is destructed, so a stale pointer still points to a node
+//    2.The walk is bounded and stops on null links of nodes being built
+//    3.Keys and values are only copied out, so they must be trivially
+//      copyable, and results are discarded unless the counter is unchanged
+//    4.The counter is checked again before every step, so a link is only
+//      followed if no write began since the walk started. A write starting
+//      right after that check may free the next node, the reader then reads
+//      one freed slot: its key may hold the pool's free list link, its other
+//      fields are old links or those of a new node, and the walk fails the
+//      next check
+//Every shared read of a reader is a relaxed atomic load (byte by byte for
+//keys and values which are not word sized), and tree_update() stores values
+//the same way. Inserts and deletes still store links and keys with the plain
+//stores of RedBlackTree, which is why try_find and its copies are excluded
+//from ThreadSanitizer.
+template <typename Key, typename Value, typename Comp = std::less<Key>>
+class ConcurrentRedBlackTree {
+private:
+//************************* Internal structures ******************************
+
+    static_assert(std::is_trivially_copyable<Key>::value, "Key must be trivially copyable");
+    static_assert(std::is_trivially_copyable<Value>::value, "Value must be trivially copyable");
+
+    typedef RedBlackTree<Key, Value, Comp, PoolNodeAllocator, ConcurrentRedBlackTreeValueSeq> Tree;
+    typedef typename Tree::Node Node;
+
+    //Deeper than any red-black tree of 2^32 keys
+    static constexpr int kMaxSteps = 128;
+
+//**************************** Racy word copies ******************************
+
+    template <typename T>
+    struct WordSized : std::integral_constant<bool,
+        (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8) &&
+        alignof(T) >= sizeof(T)> {};
+
+    //Copy *src with relaxed atomic loads, in one piece if it is word sized
+    template <typename T>
+    static T atomic_copy(const T *src) {
+        T dst;
+        atomic_copy(src, &dst, WordSized<T>());
+        return dst;
+    }
+
+    template <typename T>
+    CRBT_NO_SANITIZE_THREAD
+    static void atomic_copy(const T *src, T *dst, std::true_type) {
+        __atomic_load(src, dst, __ATOMIC_RELAXED);
+    }
+
+    template <typename T>
+    CRBT_NO_SANITIZE_THREAD
+    static void atomic_copy(const T *src, T *dst, std::false_type) {
+        const unsigned char *from = reinterpret_cast<const unsigned char *>(src);
+        unsigned char *to = reinterpret_cast<unsigned char *>(dst);
+        for (std::size_t i = 0; i < sizeof(T); i++) {
+            to[i] = __atomic_load_n(from + i, __ATOMIC_RELAXED);
+        }
+    }
+
+    //The store side of atomic_copy
+    template <typename T>
+    static void atomic_store(T *dst, const T &src) {
+        atomic_store(dst, &src, WordSized<T>());
+    }
+
+    template <typename T>
+    static void atomic_store(T *dst, const T *src, std::true_type) {
+        __atomic_store(dst, const_cast<T *>(src), __ATOMIC_RELAXED);
+    }
+
+    template <typename T>
+    static void atomic_store(T *dst, const T *src, std::false_type) {
+        const unsigned char *from = reinterpret_cast<const unsigned char *>(src);
+        unsigned char *to = reinterpret_cast<unsigned char *>(dst);
+        for (std::size_t i = 0; i < sizeof(T); i++) {
+            __atomic_store_n(to + i, from[i], __ATOMIC_RELAXED);
+        }
+    }
+
+//***************************** Sequence lock ********************************
+
+    //Writer side, called with _write_mutex held
+    void write_begin() {
+        _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void write_end() {
+        _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    //True if no write began since seq was read, orders the reads before it
+    bool unchanged(uint64_t seq) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    //Reader side: one optimistic walk, returns false if it must be retried
+    CRBT_NO_SANITIZE_THREAD
+    bool try_find(const Key &k, Value *v, bool *found) const {
+        uint64_t seq = _seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            return false;
+        }
+
+        Node *node = __atomic_load_n(&_tree._root, __ATOMIC_RELAXED);
+        Value temp;
+        bool hit = false;
+        for (int steps = 0; steps < kMaxSteps; steps++) {
+            if (node == Tree::_sentinel || node == nullptr || !unchanged(seq)) {
+                break;
+            }
+            Key nk = atomic_copy(&node->_k);
+            if (_comp(k, nk)) {
+                node = __atomic_load_n(&node->_left, __ATOMIC_RELAXED);
+            } else if (_comp(nk, k)) {
+                node = __atomic_load_n(&node->_right, __ATOMIC_RELAXED);
+            } else {
+                //The value has a sequence lock of its own, see tree_update
+                uint32_t value_seq = __atomic_load_n(&node->_value_seq, __ATOMIC_ACQUIRE);
+                if (value_seq & 1) {
+                    return false;
+                }
+                temp = atomic_copy(&node->_v);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (__atomic_load_n(&node->_value_seq, __ATOMIC_RELAXED) != value_seq) {
+                    return false;
+                }
+                hit = true;
+                break;
+            }
+        }
+
+        if (!unchanged(seq)) {
+            return false;
+        }
+        if (hit) {
+            *v = temp;
+        }
+        *found = hit;
+        return true;
+    }
+
+//****************************** Data area ***********************************
+    Comp _comp = Comp();
+    Tree _tree;
+    std::mutex _write_mutex;
+    std::atomic<uint64_t> _seq{0};
+    std::atomic<uint32_t> _size{0};
+
+public:
+//****************** Constructors and Deconstructor **************************
+
+    ConcurrentRedBlackTree() = default;
+    ConcurrentRedBlackTree(const ConcurrentRedBlackTree&) = delete;
+    ConcurrentRedBlackTree& operator=(const ConcurrentRedBlackTree&) = delete;
+
+    virtual ~ConcurrentRedBlackTree() {}
+
+//***************************** Interfaces ***********************************
+
+    bool tree_insert(const Key& k, const Value& v) {
+        std::lock_guard<std::mutex> guard(_write_mutex);
+        if (_tree.find(k) != nullptr) {
+            return false;
+        }
+
+        write_begin();
+        _tree.tree_insert(k, v);
+        write_end();
+        _size.store(_tree.tree_size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    //Overwrite the value of k, returns false if k does not exist.
+    //Only readers of k may have to retry.
+    bool tree_update(const Key& k, const Value& v) {
+        std::lock_guard<std::mutex> guard(_write_mutex);
+        Node *target = _tree.inner_find(k);
+        if (target == Tree::_sentinel) {
+            return false;
+        }
+
+        uint32_t value_seq = target->_value_seq;
+        __atomic_store_n(&target->_value_seq, value_seq + 1, __ATOMIC_RELAXED);
+        std::atomic_thread_fence(std::memory_order_release);
+        atomic_store(&target->_v, v);
+        __atomic_store_n(&target->_value_seq, value_seq + 2, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool tree_delete(const Key& k) {
+        std::lock_guard<std::mutex> guard(_write_mutex);
+        if (_tree.find(k) == nullptr) {
+            return false;
+        }
+
+        write_begin();
+        _tree.tree_delete(k);
+        write_end();
+        _size.store(_tree.tree_size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    //Lock free lookup, it spins while a writer changes the tree
+    bool tree_find(const Key& k, Value *v) const {
+        bool found = false;
+        while (!try_find(k, v, &found)) {
+            std::this_thread::yield();
+        }
+        return found;
+    }
+
+    //Delete every key one by one: dropping the node pool at once would free
+    //memory concurrent readers may still be walking. Readers wait for the
+    //whole clear, which is one write.
+    void tree_clear() {
+        std::lock_guard<std::mutex> guard(_write_mutex);
+        if (_tree.tree_size() == 0) {
+            return;
+        }
+
+        write_begin();
+        while (_tree.tree_size() > 0) {
+            Key k = (*_tree.begin()).first;
+            _tree.tree_delete(k);
+        }
+        write_end();
+        _size.store(0, std::memory_order_relaxed);
+    }
+
+    uint32_t tree_size() const {
+        return _size.load(std::memory_order_relaxed);
+    }
+
+#ifdef UNIT_TEST
+    bool check_balanced() {
+        std::lock_guard<std::mutex> guard(_write_mutex);
+        return _tree.check_balanced();
+    }
+#endif
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif  //SIMPLELIB_CONCURRENT_RED_BLACK_TREE_HPP_
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 noet: */
@@ -0,0 +1,121 @@
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <shared_mutex>
+#include "red_black_tree.hpp"
+#include "concurrent_red_black_tree.hpp"
+
+using namespace simplelib;
+
+//RedBlackTree behind a std::mutex, what callers do today
+class MutexTree {
+public:
+    bool tree_insert(int k, int v) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return _tree.tree_insert(k, v);
+    }
+
+    bool tree_delete(int k) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return _tree.tree_delete(k);
+    }
+
+    bool tree_find(int k, int *v) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return _tree.tree_find(k, v);
+    }
+
+private:
+    std::mutex _mutex;
+    RedBlackTree<int, int> _tree;
+};
+
+//RedBlackTree behind a reader/writer lock
+class SharedMutexTree {
+public:
+    bool tree_insert(int k, int v) {
+        std::lock_guard<std::shared_timed_mutex> guard(_mutex);
+        return _tree.tree_insert(k, v);
+    }
+
+    bool tree_delete(int k) {
+        std::lock_guard<std::shared_timed_mutex> guard(_mutex);
+        return _tree.tree_delete(k);
+    }
+
+    bool tree_find(int k, int *v) {
+        std::shared_lock<std::shared_timed_mutex> guard(_mutex);
+        return _tree.tree_find(k, v);
+    }
+
+private:
+    std::shared_timed_mutex _mutex;
+    RedBlackTree<int, int> _tree;
+};
+
+//threads threads run ops random operations each over keys [0, 2 * n),
+//write_permille of them are an insert or a delete, the rest are finds.
+//Returns the total throughput in Mops/s.
+template <typename Tree>
+double bench_mix(size_t n, int threads, size_t ops, int write_permille) {
+    Tree tree;
+    for (size_t k = 0; k < 2 * n; k += 2) {
+        tree.tree_insert(static_cast<int>(k), static_cast<int>(k));
+    }
+
+    std::vector<std::thread> workers;
+    std::vector<long> sums(threads, 0);
+    auto begin = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&tree, &sums, n, ops, write_permille, t]() {
+            std::default_random_engine engine(t);
+            std::uniform_int_distribution<int> key_dist(0, static_cast<int>(2 * n - 1));
+            long sum = 0;
+            for (size_t i = 0; i < ops; i++) {
+                int k = key_dist(engine);
+                if (static_cast<int>(engine() % 1000) < write_permille) {
+                    if (!tree.tree_insert(k, k)) {
+                        tree.tree_delete(k);
+                    }
+                } else {
+                    int v = 0;
+                    if (tree.tree_find(k, &v)) {
+                        sum += v;
+                    }
+                }
+            }
+            sums[t] = sum;
+        });
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+    return threads * ops / 1000.0 / ms;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 32;
+    size_t ops = 200000;
+
+    printf("== Read/write mix: %zu keys, %zu ops per thread, %u hardware threads ==\n",
+           n, ops, std::thread::hardware_concurrency());
+    for (int write_permille : {0, 10, 100}) {
+        printf("-- %.1f%% writes --\n", write_permille / 10.0);
+        printf("%8s %14s %14s %14s\n", "threads", "std::mutex", "shared_mutex", "seqlock");
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            double mutex = bench_mix<MutexTree>(n, threads, ops, write_permille);
+            double shared = bench_mix<SharedMutexTree>(n, threads, ops, write_permille);
+            double seqlock = bench_mix<ConcurrentRedBlackTree<int, int>>(n, threads, ops, write_permille);
+            printf("%8d %9.2f Mops %9.2f Mops %9.2f Mops\n", threads, mutex, shared, seqlock);
+        }
+    }
+
+    return 0;
+}
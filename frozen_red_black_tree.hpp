@@ -0,0 +1,379 @@
+#ifndef SIMPLELIB_FROZEN_RED_BLACK_TREE_HPP_
+#define SIMPLELIB_FROZEN_RED_BLACK_TREE_HPP_
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <iterator>
+#include <functional>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "red_black_tree.hpp"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//Header of the file image of a FrozenRedBlackTree. The image only holds
+//offsets from its start, so it works wherever it is mapped:
+//    header | keys[count + 1] | values[count + 1]
+//both arrays start on a cache line and are in Eytzinger order, slot 0 unused.
+struct FrozenImageHeader {
+    //"SLFROZEN" read as a little endian integer
+    static constexpr uint64_t kMagic = 0x4e455a4f52464c53ULL;
+    static constexpr uint32_t kVersion = 1;
+
+    uint64_t _magic;
+    uint32_t _version;
+    uint32_t _key_size;
+    uint32_t _value_size;
+    uint32_t _reserved;
+    uint64_t _count;
+    uint64_t _key_offset;
+    uint64_t _value_offset;
+    uint64_t _file_size;
+};
+
+//An immutable copy of a RedBlackTree for maps which are built once and then
+//only queried. Keys are stored in Eytzinger (BFS) order in one array:
+//the root at 1, the children of i at 2i and 2i + 1, and values in a parallel
+//array, so a lookup touches only keys and no pointers.
+//The search is branchless, the next step is computed from one comparison,
+//and prefetches the cache line holding the descendants a few levels down,
+//so misses overlap with the comparisons of the levels between.
+//freeze() copies a tree in O(n) and thaw() turns it back into a tree in O(n).
+//save() writes the layout to a file which map() queries in place, without
+//any parsing: pages are faulted in as lookups touch them, so a service can
+//start serving right away instead of rebuilding its map. Both need trivially
+//copyable keys and values, and the image is only readable on machines with
+//the same endianness and type layout.
+template <typename Key, typename Value, typename Comp = std::less<Key>>
+class FrozenRedBlackTree {
+private:
+//************************* Internal structures ******************************
+
+    //About the keys per cache line, a power of two: the descendants of i
+    //log2(kPrefetchStride) levels down are the kPrefetchStride keys from
+    //kPrefetchStride * i on
+    static constexpr std::size_t kPrefetchStride = sizeof(Key) <= 4 ? 16 : sizeof(Key) <= 8 ? 8 : 4;
+
+//******************************** Layout ************************************
+
+    //Fill the subtree at i from an in-order sequence
+    template <typename Iterator>
+    void inner_build(Iterator &it, std::size_t i) {
+        if (i > _size) {
+            return;
+        }
+        inner_build(it, 2 * i);
+        _key_store[i] = (*it).first;
+        _value_store[i] = (*it).second;
+        ++it;
+        inner_build(it, 2 * i + 1);
+    }
+
+    //The index following i in key order, 0 after the last one
+    std::size_t successor(std::size_t i) const {
+        if (2 * i + 1 <= _size) {
+            i = 2 * i + 1;
+            while (2 * i <= _size) {
+                i = 2 * i;
+            }
+            return i;
+        }
+        //Climb while i is a right child, then once more
+        return i >> __builtin_ffsll(~static_cast<long long>(i));
+    }
+
+    std::size_t first() const {
+        std::size_t i = _size == 0 ? 0 : 1;
+        while (2 * i <= _size && i != 0) {
+            i = 2 * i;
+        }
+        return i;
+    }
+
+//******************************* Finder *************************************
+
+    //Index of the first key not less than k, 0 if there is none
+    std::size_t inner_lower_bound(const Key &k) const {
+        const Key *keys = _keys;
+        std::size_t i = 1;
+        while (i <= _size) {
+            __builtin_prefetch(keys + kPrefetchStride * i);
+            i = 2 * i + _comp(keys[i], k);
+        }
+        //The path went right after the answer for every trailing 1 bit
+        return i >> __builtin_ffsll(~static_cast<long long>(i));
+    }
+
+//******************************** Image *************************************
+
+    static constexpr std::size_t kImageAlign = 64;
+
+    static uint64_t align_up(uint64_t n) {
+        return (n + kImageAlign - 1) / kImageAlign * kImageAlign;
+    }
+
+    static bool write_padded(FILE *file, const void *data, std::size_t size) {
+        static const char kZeros[kImageAlign] = {0};
+        std::size_t padding = align_up(size) - size;
+        return fwrite(data, 1, size, file) == size && fwrite(kZeros, 1, padding, file) == padding;
+    }
+
+    //Point the arrays to the owned storage
+    void use_store() {
+        unmap();
+        _keys = _key_store.data();
+        _values = _value_store.data();
+    }
+
+    void unmap() {
+        if (_image != nullptr) {
+            munmap(_image, _image_size);
+            _image = nullptr;
+            _image_size = 0;
+        }
+    }
+
+//****************************** Data area ***********************************
+    Comp _comp = Comp();
+    //Index 0 is unused so that children of i are 2i and 2i + 1.
+    //The arrays point into the stores below or into a mapped image.
+    const Key *_keys = nullptr;
+    const Value *_values = nullptr;
+    std::size_t _size = 0;
+    std::vector<Key> _key_store;
+    std::vector<Value> _value_store;
+    void *_image = nullptr;
+    std::size_t _image_size = 0;
+
+public:
+//****************************** Iterators ***********************************
+
+    //Forward iterator in key order, dereference gives a pair of references
+    class const_iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key&, const Value&> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type reference;
+        typedef void pointer;
+
+        const_iterator() = default;
+
+        reference operator*() const {
+            return reference(_tree->_keys[_i], _tree->_values[_i]);
+        }
+
+        const Key & key() const {
+            return _tree->_keys[_i];
+        }
+
+        const Value & value() const {
+            return _tree->_values[_i];
+        }
+
+        const_iterator & operator++() {
+            _i = _tree->successor(_i);
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const const_iterator &other) const {
+            return _i == other._i;
+        }
+
+        bool operator!=(const const_iterator &other) const {
+            return _i != other._i;
+        }
+
+    private:
+        friend class FrozenRedBlackTree;
+
+        const_iterator(const FrozenRedBlackTree *tree, std::size_t i) : _tree(tree), _i(i) {}
+
+        const FrozenRedBlackTree *_tree = nullptr;
+        std::size_t _i = 0;
+    };
+
+//****************** Constructors and Deconstructor **************************
+
+    FrozenRedBlackTree() = default;
+    FrozenRedBlackTree(const FrozenRedBlackTree&) = delete;
+    FrozenRedBlackTree& operator=(const FrozenRedBlackTree&) = delete;
+
+    virtual ~FrozenRedBlackTree() {
+        unmap();
+    }
+
+//***************************** Interfaces ***********************************
+
+    //Replace the content with a copy of tree, walking it in key order once
+    template <template <typename> class Alloc, typename Augment>
+    void freeze(const RedBlackTree<Key, Value, Comp, Alloc, Augment> &tree) {
+        _size = 0;
+        for (auto it = tree.begin(); it != tree.end(); ++it) {
+            _size++;
+        }
+        _key_store.assign(_size + 1, Key());
+        _value_store.assign(_size + 1, Value());
+        auto it = tree.begin();
+        inner_build(it, 1);
+        use_store();
+    }
+
+    //Write the image of this tree to path, returns false on any IO error
+    bool save(const char *path) const {
+        static_assert(std::is_trivially_copyable<Key>::value, "save() needs trivially copyable keys");
+        static_assert(std::is_trivially_copyable<Value>::value,
+                      "save() needs trivially copyable values");
+        FrozenImageHeader header;
+        memset(&header, 0, sizeof(header));
+        header._magic = FrozenImageHeader::kMagic;
+        header._version = FrozenImageHeader::kVersion;
+        header._key_size = sizeof(Key);
+        header._value_size = sizeof(Value);
+        header._count = _size;
+        header._key_offset = align_up(sizeof(header));
+        header._value_offset = header._key_offset + align_up((_size + 1) * sizeof(Key));
+        header._file_size = header._value_offset + align_up((_size + 1) * sizeof(Value));
+
+        //An empty tree still has slot 0
+        Key no_key = Key();
+        Value no_value = Value();
+        FILE *file = fopen(path, "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        bool ok = write_padded(file, &header, sizeof(header)) &&
+                  write_padded(file, _keys != nullptr ? _keys : &no_key, (_size + 1) * sizeof(Key)) &&
+                  write_padded(file, _values != nullptr ? _values : &no_value,
+                               (_size + 1) * sizeof(Value));
+        return fclose(file) == 0 && ok;
+    }
+
+    //Replace the content with the image at path written by save(), mapped
+    //read only and queried in place. Nothing is read up front, pages are
+    //loaded by the lookups touching them. Returns false and keeps the
+    //content if the file is not a valid image for these key/value types.
+    bool map(const char *path) {
+        static_assert(std::is_trivially_copyable<Key>::value, "map() needs trivially copyable keys");
+        static_assert(std::is_trivially_copyable<Value>::value,
+                      "map() needs trivially copyable values");
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        void *image = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(FrozenImageHeader)) {
+            image = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (image == MAP_FAILED) {
+            return false;
+        }
+
+        const FrozenImageHeader *header = static_cast<const FrozenImageHeader *>(image);
+        uint64_t count = header->_count;
+        if (header->_magic != FrozenImageHeader::kMagic ||
+            header->_version != FrozenImageHeader::kVersion ||
+            header->_key_size != sizeof(Key) || header->_value_size != sizeof(Value) ||
+            header->_file_size != static_cast<uint64_t>(st.st_size) ||
+            header->_key_offset % kImageAlign != 0 || header->_value_offset % kImageAlign != 0 ||
+            //Offsets are ordered inside the file before any arithmetic on them,
+            //so a crafted header cannot wrap around
+            header->_key_offset < sizeof(FrozenImageHeader) ||
+            header->_key_offset > header->_value_offset ||
+            header->_value_offset > header->_file_size ||
+            count > UINT32_MAX ||
+            count >= header->_file_size / sizeof(Key) || count >= header->_file_size / sizeof(Value) ||
+            (count + 1) * sizeof(Key) > header->_value_offset - header->_key_offset ||
+            (count + 1) * sizeof(Value) > header->_file_size - header->_value_offset) {
+            munmap(image, st.st_size);
+            return false;
+        }
+
+        //Lookups jump around, do not read ahead
+        madvise(image, st.st_size, MADV_RANDOM);
+        unmap();
+        _key_store.clear();
+        _value_store.clear();
+        _image = image;
+        _image_size = st.st_size;
+        _size = count;
+        _keys = reinterpret_cast<const Key *>(static_cast<const char *>(image) + header->_key_offset);
+        _values = reinterpret_cast<const Value *>(static_cast<const char *>(image) +
+                                                  header->_value_offset);
+        return true;
+    }
+
+    //Replace the content of tree with the keys of this one, in O(n)
+    template <template <typename> class Alloc, typename Augment>
+    void thaw(RedBlackTree<Key, Value, Comp, Alloc, Augment> *tree) const {
+        tree->bulk_load(begin(), end());
+    }
+
+    bool tree_find(const Key& k, Value *v) const {
+        const Value *target = find(k);
+        if (target == nullptr) {
+            return false;
+        }
+
+        *v = *target;
+        return true;
+    }
+
+    //Return the value of k in place, or nullptr if k does not exist
+    const Value * find(const Key& k) const {
+        std::size_t i = inner_lower_bound(k);
+        if (i == 0 || _comp(k, _keys[i])) {
+            return nullptr;
+        }
+        return &_values[i];
+    }
+
+    //Visit every key in [lo, hi) in order with visitor(const Key&, const Value&)
+    //Returns the number of keys visited
+    template <typename Visitor>
+    std::size_t range(const Key &lo, const Key &hi, Visitor visitor) const {
+        std::size_t count = 0;
+        for (std::size_t i = inner_lower_bound(lo); i != 0 && _comp(_keys[i], hi); i = successor(i)) {
+            visitor(_keys[i], _values[i]);
+            count++;
+        }
+        return count;
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, first());
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator lower_bound(const Key &k) const {
+        return const_iterator(this, inner_lower_bound(k));
+    }
+
+    uint32_t tree_size() const {
+        return static_cast<uint32_t>(_size);
+    }
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif  //SIMPLELIB_FROZEN_RED_BLACK_TREE_HPP_
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 noet: */
@@ -0,0 +1,210 @@
+#ifndef SIMPLELIB_FUTEX_HPP_
+#define SIMPLELIB_FUTEX_HPP_
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <cstdint>
+#include "common.h"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//Thin wrapper over the Linux futex syscall on a 32-bit atomic word
+class Futex {
+ public:
+  //Sleep while *word == expected, at most timeout if one is given. Returns on a
+  //wake, a timeout, a signal or a changed word, callers recheck their condition.
+  static void Wait(std::atomic<uint32_t> *word, uint32_t expected,
+                   const struct timespec *timeout = nullptr) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT_PRIVATE,
+            expected, timeout, nullptr, 0);
+  }
+
+  static void Wake(std::atomic<uint32_t> *word, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE,
+            count, nullptr, nullptr, 0);
+  }
+};
+
+//Drop-in for std::condition_variable as the COND policy of SimpleBlockingQueue.
+//A waiter first spins on a sequence word, then parks on it with a futex. Unlike
+//std::condition_variable, notify_one/notify_all must be called with the mutex
+//held: the waiter and pending-wake counts live under it, so a notify makes a
+//syscall only when a waiter exists that no earlier notify has woken.
+class SpinFutexCondition {
+ public:
+  static const int kSpinCount = 2000;
+
+  SpinFutexCondition() = default;
+  SpinFutexCondition(const SpinFutexCondition &) = delete;
+  SpinFutexCondition &operator=(const SpinFutexCondition &) = delete;
+
+  template<typename Predicate>
+  void wait(std::unique_lock<std::mutex> &locker, Predicate pred) {
+    while (!pred()) {
+      Block(locker, nullptr);
+    }
+  }
+
+  template<typename Rep, typename Period, typename Predicate>
+  bool wait_for(std::unique_lock<std::mutex> &locker,
+                const std::chrono::duration<Rep, Period> &timeout,
+                Predicate pred) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred()) {
+      auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) {
+        //timeout
+        return pred();
+      }
+      Block(locker, &left);
+    }
+    return true;
+  }
+
+  void notify_one() {
+    Notify(1);
+  }
+
+  void notify_all() {
+    Notify(std::numeric_limits<uint32_t>::max());
+  }
+ private:
+  //Spinning only helps when the notifier can run on another CPU
+  static int SpinCount() {
+    static const int spins = std::thread::hardware_concurrency() > 1 ? kSpinCount : 0;
+    return spins;
+  }
+
+  static void Pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  //Called with locker held and the predicate false, left is nullptr for no timeout
+  void Block(std::unique_lock<std::mutex> &locker, const std::chrono::nanoseconds *left) {
+    uint32_t seq = seq_.load();
+    ++waiters_;
+    locker.unlock();
+    for (int i = SpinCount(); i > 0 && seq_.load(std::memory_order_relaxed) == seq; --i) {
+      Pause();
+    }
+    if (seq_.load() == seq) {
+      if (left == nullptr) {
+        Futex::Wait(&seq_, seq);
+      } else {
+        auto ns = left->count();
+        struct timespec timeout;
+        timeout.tv_sec = ns / 1000000000;
+        timeout.tv_nsec = ns % 1000000000;
+        Futex::Wait(&seq_, seq, &timeout);
+      }
+    }
+    locker.lock();
+    --waiters_;
+    //Whoever leaves absorbs a pending wake: a wake that found nobody in the
+    //kernel was meant for a waiter that saw seq_ move and never parked
+    if (wakes_ > 0) {
+      --wakes_;
+    }
+  }
+
+  //Called with the mutex held. Any waiter that has not parked yet sees seq_ move
+  //and does not sleep, parked ones need one kernel wake each
+  void Notify(uint32_t count) {
+    seq_.fetch_add(1);
+    if (waiters_ > wakes_) {
+      count = std::min(count, waiters_ - wakes_);
+      wakes_ += count;
+      Futex::Wake(&seq_, static_cast<int>(count));
+    }
+  }
+
+  std::atomic<uint32_t> seq_{0};
+  //Guarded by the caller's mutex
+  uint32_t waiters_ = 0;
+  uint32_t wakes_ = 0;
+};
+
+//Event count (as in Folly's EventCount): a wakeup primitive with no mutex and no
+//predicate of its own, so one instance can stand for any number of queues.
+//A waiter announces itself, re-checks its condition and only then parks:
+//
+//  uint32_t key = event.PrepareWait();
+//  if (condition()) { event.CancelWait(); } else { event.Wait(key); }
+//
+//Notify() after making the condition true costs one atomic load when nobody
+//is waiting. The seq_cst waiter count orders against the notifier's state
+//change, so either the waiter sees the state or the notifier sees the waiter.
+class EventCount {
+ public:
+  EventCount() = default;
+  EventCount(const EventCount &) = delete;
+  EventCount &operator=(const EventCount &) = delete;
+
+  uint32_t PrepareWait() {
+    waiters_.fetch_add(1);
+    return epoch_.load();
+  }
+
+  void CancelWait() {
+    waiters_.fetch_sub(1);
+  }
+
+  //Returns once a Notify() happened after PrepareWait() returned key
+  void Wait(uint32_t key) {
+    while (epoch_.load() == key) {
+      Futex::Wait(&epoch_, key);
+    }
+    waiters_.fetch_sub(1);
+  }
+
+  //Like Wait, returns false if timeout expired first
+  template<typename Rep, typename Period>
+  bool WaitFor(uint32_t key, const std::chrono::duration<Rep, Period> &timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (epoch_.load() == key) {
+      auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          deadline - std::chrono::steady_clock::now()).count();
+      if (left <= 0) {
+        //timeout
+        waiters_.fetch_sub(1);
+        return false;
+      }
+      struct timespec ts;
+      ts.tv_sec = left / 1000000000;
+      ts.tv_nsec = left % 1000000000;
+      Futex::Wait(&epoch_, key, &ts);
+    }
+    waiters_.fetch_sub(1);
+    return true;
+  }
+
+  //Wake up to count waiters
+  void Notify(int count = 1) {
+    if (waiters_.load() > 0) {
+      epoch_.fetch_add(1);
+      Futex::Wake(&epoch_, count);
+    }
+  }
+
+  void NotifyAll() {
+    Notify(std::numeric_limits<int>::max());
+  }
+ private:
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<uint32_t> waiters_{0};
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif // SIMPLELIB_FUTEX_HPP_
@@ -0,0 +1,142 @@
+#ifndef SIMPLELIB_NODE_ALLOCATOR_HPP_
+#define SIMPLELIB_NODE_ALLOCATOR_HPP_
+
+#include <new>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <type_traits>
+#include "common.h"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//Node allocators are used by node based containers such as RedBlackTree.
+//An allocator for node type T provides:
+//    T * create(Args&&... args)  construct a node
+//    void destroy(T *node)       destruct a node and give its memory back
+//    void release_all()          give back the memory of every node at once,
+//                                the nodes must have been destructed before
+//    void reserve(size_t n)      hint that n nodes are about to be created in a row
+//    kReleaseAll                 true if release_all() really frees the nodes,
+//                                so the container can skip freeing them one by one
+//    kTransferable               true if a node created by one allocator may be
+//                                destroyed by another one, so containers may move
+//                                nodes between each other, e.g. RedBlackTree::tree_join
+
+//Every node comes from global new/delete
+template <typename T>
+class NewNodeAllocator {
+public:
+    static constexpr bool kReleaseAll = false;
+    static constexpr bool kTransferable = true;
+
+    template <typename ...Args>
+    T * create(Args&&... args) {
+        return new T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T *node) {
+        delete node;
+    }
+
+    void release_all() {}
+
+    void reserve(std::size_t) {}
+};
+
+//Nodes are carved out of slabs owned by the allocator, freed nodes are kept in
+//a free list and reused by later creations. Slabs grow geometrically and are
+//only returned by release_all() or the destructor.
+//Not thread safe, every container should own its own pool.
+template <typename T>
+class PoolNodeAllocator {
+private:
+    union Slot {
+        Slot *_next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+    };
+
+    static constexpr std::size_t kMinSlabSize = 64;
+    static constexpr std::size_t kMaxSlabSize = 65536;
+
+    void grow(std::size_t n) {
+        Slot *slab = new Slot[n];
+        _slabs.push_back(slab);
+        _cursor = slab;
+        _limit = slab + n;
+    }
+
+    std::vector<Slot *> _slabs;
+    Slot *_free = nullptr;
+    Slot *_cursor = nullptr;
+    Slot *_limit = nullptr;
+    std::size_t _next_slab_size = kMinSlabSize;
+
+public:
+    static constexpr bool kReleaseAll = true;
+    static constexpr bool kTransferable = false;
+
+    PoolNodeAllocator() = default;
+    PoolNodeAllocator(const PoolNodeAllocator&) = delete;
+    PoolNodeAllocator& operator=(const PoolNodeAllocator&) = delete;
+
+    ~PoolNodeAllocator() {
+        release_all();
+    }
+
+    template <typename ...Args>
+    T * create(Args&&... args) {
+        Slot *slot = _free;
+        if (slot != nullptr) {
+            _free = slot->_next;
+        } else {
+            if (_cursor == _limit) {
+                grow(_next_slab_size);
+                if (_next_slab_size < kMaxSlabSize) {
+                    _next_slab_size *= 2;
+                }
+            }
+            slot = _cursor++;
+        }
+        return new(&slot->_storage) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T *node) {
+        node->~T();
+        Slot *slot = reinterpret_cast<Slot *>(node);
+        slot->_next = _free;
+        _free = slot;
+    }
+
+    void release_all() {
+        for (Slot *slab : _slabs) {
+            delete[] slab;
+        }
+        _slabs.clear();
+        _free = nullptr;
+        _cursor = nullptr;
+        _limit = nullptr;
+        _next_slab_size = kMinSlabSize;
+    }
+
+    //With an empty free list, the next n creations come out of the rest of
+    //the current slab and then one new contiguous slab, in creation order
+    void reserve(std::size_t n) {
+        std::size_t left = static_cast<std::size_t>(_limit - _cursor);
+        if (left < n) {
+            //Hand out the rest of the current slab first, in address order
+            while (_limit != _cursor) {
+                Slot *slot = --_limit;
+                slot->_next = _free;
+                _free = slot;
+            }
+            grow(n - left > kMinSlabSize ? n - left : kMinSlabSize);
+        }
+    }
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif  //SIMPLELIB_NODE_ALLOCATOR_HPP_
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 noet: */
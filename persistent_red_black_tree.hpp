@@ -0,0 +1,477 @@
+#ifndef SIMPLELIB_PERSISTENT_RED_BLACK_TREE_HPP_
+#define SIMPLELIB_PERSISTENT_RED_BLACK_TREE_HPP_
+
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <functional>
+#include "common.h"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//A red-black tree with O(1) snapshots for consistent readers.
+//Writers update the live tree under a mutex. snapshot() returns a frozen
+//point-in-time view which any thread can read without locking, and which
+//never blocks the writers.
+//
+//It is a persistent left-leaning red-black tree (2-3 variant) with path
+//copying: nodes carry an intrusive reference count of the parents and
+//snapshots pointing to them. A writer updates a node in place if it is only
+//referenced once, since it can not be seen by any snapshot then, otherwise
+//it copies the node first. So only the O(log n) nodes on paths shared with
+//a live snapshot get copied, and without snapshots nothing is copied.
+//A node is freed by whoever drops its last reference, the writer or the
+//thread releasing the last snapshot holding it.
+//
+//Key and Value must be copy constructible. Nodes come from global new/delete
+//as they may be freed by any thread.
+template <typename Key, typename Value, typename Comp = std::less<Key>>
+class PersistentRedBlackTree {
+private:
+//************************* Internal structures ******************************
+
+    //Internal enum class Color, user won't care about this
+    enum class Color : uint8_t { BLACK = 0, RED = 1 };
+
+    //Internal struct Node, user won't care about this
+    struct Node {
+        template <typename K, typename V>
+        Node(K &&key, V &&value, Node *left, Node *right, Color color)
+            : _k(std::forward<K>(key)), _v(std::forward<V>(value)),
+              _left(left), _right(right), _color(color) {}
+
+        Key _k;
+        Value _v;
+        Node *_left;
+        Node *_right;
+        std::atomic<uint32_t> _refs{1};
+        Color _color;
+    };
+
+//************************** Reference counting ******************************
+
+    static void retain(Node *node) {
+        if (node != nullptr) {
+            node->_refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    //Drop a reference, free the node and drop its children on the last one
+    static void release(Node *node) {
+        while (node != nullptr && node->_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(node->_left);
+            Node *right = node->_right;
+            delete node;
+            node = right;
+        }
+    }
+
+    //Return a node which can be written in place of node. The link to node
+    //must come from the live root or a node already owned by the writer, so
+    //a single reference means nobody else can reach it. Otherwise node is
+    //copied, its children gain a parent and node loses the link.
+    static Node * own(Node *node) {
+        if (node->_refs.load(std::memory_order_acquire) == 1) {
+            return node;
+        }
+        Node *copy = new Node(node->_k, node->_v, node->_left, node->_right, node->_color);
+        retain(copy->_left);
+        retain(copy->_right);
+        release(node);
+        return copy;
+    }
+
+//*************************** Balance helpers ********************************
+    //All of them take an owned node and return the owned root of the subtree
+
+    static bool is_red(const Node *node) {
+        return node != nullptr && node->_color == Color::RED;
+    }
+
+    static void flip(Node *node) {
+        node->_color = node->_color == Color::RED ? Color::BLACK : Color::RED;
+    }
+
+    //Left rotate:
+    //          node                           temp
+    //        /     \                         /     \
+    //       x       temp        -->      node       z
+    //              /    \               /    \
+    //             y      z             x      y
+    //
+    static Node * rotate_left(Node *node) {
+        Node *temp = own(node->_right);
+        node->_right = temp->_left;
+        temp->_left = node;
+        temp->_color = node->_color;
+        node->_color = Color::RED;
+        return temp;
+    }
+
+    //Right rotate:
+    //          node                           temp
+    //        /     \                         /     \
+    //    temp       z           -->         x      node
+    //   /    \                                    /    \
+    //  x      y                                  y      z
+    //
+    static Node * rotate_right(Node *node) {
+        Node *temp = own(node->_left);
+        node->_left = temp->_right;
+        temp->_right = node;
+        temp->_color = node->_color;
+        node->_color = Color::RED;
+        return temp;
+    }
+
+    static void flip_colors(Node *node) {
+        node->_left = own(node->_left);
+        node->_right = own(node->_right);
+        flip(node);
+        flip(node->_left);
+        flip(node->_right);
+    }
+
+    //Restore the left-leaning invariants on the way up
+    static Node * balance(Node *node) {
+        if (is_red(node->_right) && !is_red(node->_left)) {
+            node = rotate_left(node);
+        }
+        if (is_red(node->_left) && is_red(node->_left->_left)) {
+            node = rotate_right(node);
+        }
+        if (is_red(node->_left) && is_red(node->_right)) {
+            flip_colors(node);
+        }
+        return node;
+    }
+
+    //Make node->_left or one of its children red before descending left
+    static Node * move_red_left(Node *node) {
+        flip_colors(node);
+        if (is_red(node->_right->_left)) {
+            node->_right = rotate_right(node->_right);
+            node = rotate_left(node);
+            flip_colors(node);
+        }
+        return node;
+    }
+
+    //Make node->_right or one of its children red before descending right
+    static Node * move_red_right(Node *node) {
+        flip_colors(node);
+        if (is_red(node->_left->_left)) {
+            node = rotate_right(node);
+            flip_colors(node);
+        }
+        return node;
+    }
+
+//***************************** Insertion ************************************
+
+    //k must not exist in the subtree
+    template <typename K, typename V>
+    Node * inner_insert(Node *node, K &&k, V &&v) {
+        if (node == nullptr) {
+            return new Node(std::forward<K>(k), std::forward<V>(v), nullptr, nullptr, Color::RED);
+        }
+
+        node = own(node);
+        if (_comp(k, node->_k)) {
+            node->_left = inner_insert(node->_left, std::forward<K>(k), std::forward<V>(v));
+        } else {
+            node->_right = inner_insert(node->_right, std::forward<K>(k), std::forward<V>(v));
+        }
+        return balance(node);
+    }
+
+    //Insert under the writer lock unless k exists
+    template <typename K, typename V>
+    bool try_insert(K&& k, V&& v) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        if (inner_find(_root, k, _comp) != nullptr) {
+            return false;
+        }
+
+        _root = inner_insert(_root, std::forward<K>(k), std::forward<V>(v));
+        if (_root->_color == Color::RED) {
+            _root = own(_root);
+            _root->_color = Color::BLACK;
+        }
+        _size++;
+        return true;
+    }
+
+//******************************* Deletion ***********************************
+
+    Node * delete_min(Node *node) {
+        if (node->_left == nullptr) {
+            release(node);
+            return nullptr;
+        }
+
+        node = own(node);
+        if (!is_red(node->_left) && !is_red(node->_left->_left)) {
+            node = move_red_left(node);
+        }
+        node->_left = delete_min(node->_left);
+        return balance(node);
+    }
+
+    //k must exist in the subtree
+    Node * inner_delete(Node *node, const Key &k) {
+        node = own(node);
+        if (_comp(k, node->_k)) {
+            if (!is_red(node->_left) && !is_red(node->_left->_left)) {
+                node = move_red_left(node);
+            }
+            node->_left = inner_delete(node->_left, k);
+        } else {
+            if (is_red(node->_left)) {
+                node = rotate_right(node);
+            }
+            if (!_comp(node->_k, k) && node->_right == nullptr) {
+                release(node);
+                return nullptr;
+            }
+            if (!is_red(node->_right) && !is_red(node->_right->_left)) {
+                node = move_red_right(node);
+            }
+            if (!_comp(node->_k, k)) {
+                //Take over the successor's payload, which may be shared, so copy it
+                const Node *next = minimum(node->_right);
+                node->_k = next->_k;
+                node->_v = next->_v;
+                node->_right = delete_min(node->_right);
+            } else {
+                node->_right = inner_delete(node->_right, k);
+            }
+        }
+        return balance(node);
+    }
+
+//******************************* Finder *************************************
+
+    static const Node * minimum(const Node *node) {
+        while (node->_left != nullptr) {
+            node = node->_left;
+        }
+        return node;
+    }
+
+    static const Node * inner_find(const Node *node, const Key &k, const Comp &comp) {
+        while (node != nullptr) {
+            if (comp(k, node->_k)) {
+                node = node->_left;
+            } else if (comp(node->_k, k)) {
+                node = node->_right;
+            } else {
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    //In-order visit of the keys in [lo, hi), returns the number visited
+    template <typename Visitor>
+    static std::size_t inner_range(const Node *node, const Key &lo, const Key &hi,
+                                   const Comp &comp, Visitor &visitor) {
+        std::size_t count = 0;
+        while (node != nullptr) {
+            if (comp(node->_k, lo)) {
+                node = node->_right;
+            } else if (!comp(node->_k, hi)) {
+                node = node->_left;
+            } else {
+                count += inner_range(node->_left, lo, hi, comp, visitor);
+                visitor(node->_k, node->_v);
+                count++;
+                node = node->_right;
+            }
+        }
+        return count;
+    }
+
+#ifdef UNIT_TEST
+    //Black height of the subtree, or -1 if it breaks any invariant
+    int inner_check(const Node *node, const Key *lo, const Key *hi) const {
+        if (node == nullptr) {
+            return 0;
+        }
+        if (node->_refs.load() == 0 || is_red(node->_right) ||
+            (is_red(node) && is_red(node->_left)) ||
+            (lo != nullptr && !_comp(*lo, node->_k)) || (hi != nullptr && !_comp(node->_k, *hi))) {
+            return -1;
+        }
+        int left = inner_check(node->_left, lo, &node->_k);
+        int right = inner_check(node->_right, &node->_k, hi);
+        if (left < 0 || left != right) {
+            return -1;
+        }
+        return left + (is_red(node) ? 0 : 1);
+    }
+#endif
+
+//****************************** Data area ***********************************
+    Comp _comp = Comp();
+    Node *_root = nullptr;
+    uint32_t _size = 0;
+    //Serializes the writers and snapshot()
+    std::mutex _mutex;
+
+public:
+//******************************* Snapshot ***********************************
+
+    //A frozen view of the tree, it keeps its nodes alive until destructed.
+    //Reading is lock free and safe from any number of threads; copying a
+    //snapshot is O(1) as well.
+    class Snapshot {
+    public:
+        Snapshot() = default;
+
+        Snapshot(const Snapshot &other) : _root(other._root), _size(other._size) {
+            retain(_root);
+        }
+
+        Snapshot(Snapshot &&other) : _root(other._root), _size(other._size) {
+            other._root = nullptr;
+            other._size = 0;
+        }
+
+        Snapshot& operator=(Snapshot other) {
+            std::swap(_root, other._root);
+            std::swap(_size, other._size);
+            return *this;
+        }
+
+        ~Snapshot() {
+            release(_root);
+        }
+
+        //Return the value of k, or nullptr if k does not exist.
+        //The pointer is valid as long as the snapshot.
+        const Value * find(const Key &k) const {
+            const Node *node = inner_find(_root, k, Comp());
+            return node == nullptr ? nullptr : &node->_v;
+        }
+
+        bool tree_find(const Key &k, Value *v) const {
+            const Value *target = find(k);
+            if (target == nullptr) {
+                return false;
+            }
+
+            *v = *target;
+            return true;
+        }
+
+        //Visit every key in [lo, hi) in order with visitor(const Key&, const Value&)
+        //Returns the number of keys visited
+        template <typename Visitor>
+        std::size_t range(const Key &lo, const Key &hi, Visitor visitor) const {
+            return inner_range(_root, lo, hi, Comp(), visitor);
+        }
+
+        uint32_t tree_size() const {
+            return _size;
+        }
+
+    private:
+        friend class PersistentRedBlackTree;
+
+        Snapshot(Node *root, uint32_t size) : _root(root), _size(size) {}
+
+        Node *_root = nullptr;
+        uint32_t _size = 0;
+    };
+
+//****************** Constructors and Deconstructor **************************
+
+    PersistentRedBlackTree() = default;
+    PersistentRedBlackTree(const PersistentRedBlackTree&) = delete;
+    PersistentRedBlackTree& operator=(const PersistentRedBlackTree&) = delete;
+
+    //Snapshots may outlive the tree, they keep their own nodes
+    virtual ~PersistentRedBlackTree() {
+        tree_clear();
+    }
+
+//***************************** Interfaces ***********************************
+
+    //Take a consistent view of the tree in O(1), it only waits for the
+    //writer currently in progress, if any
+    Snapshot snapshot() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        retain(_root);
+        return Snapshot(_root, _size);
+    }
+
+    bool tree_insert(const Key& k, const Value& v) {
+        return try_insert(k, v);
+    }
+
+    bool tree_insert(Key&& k, Value&& v) {
+        return try_insert(std::move(k), std::move(v));
+    }
+
+    bool tree_delete(const Key& k) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        if (inner_find(_root, k, _comp) == nullptr) {
+            return false;
+        }
+
+        if (!is_red(_root->_left) && !is_red(_root->_right)) {
+            _root = own(_root);
+            _root->_color = Color::RED;
+        }
+        _root = inner_delete(_root, k);
+        if (_root != nullptr && _root->_color == Color::RED) {
+            _root = own(_root);
+            _root->_color = Color::BLACK;
+        }
+        _size--;
+        return true;
+    }
+
+    //Lookup in the live tree, it waits for the writers.
+    //Readers which must not wait should look up in a snapshot instead.
+    bool tree_find(const Key& k, Value *v) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        const Node *target = inner_find(_root, k, _comp);
+        if (target == nullptr) {
+            return false;
+        }
+
+        *v = target->_v;
+        return true;
+    }
+
+    void tree_clear() {
+        Node *root = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            std::swap(root, _root);
+            _size = 0;
+        }
+        release(root);
+    }
+
+    uint32_t tree_size() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return _size;
+    }
+
+#ifdef UNIT_TEST
+    bool check_balanced() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return !is_red(_root) && inner_check(_root, nullptr, nullptr) >= 0;
+    }
+#endif
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif  //SIMPLELIB_PERSISTENT_RED_BLACK_TREE_HPP_
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 noet: */
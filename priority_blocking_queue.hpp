@@ -0,0 +1,278 @@
+#ifndef SIMPLELIB_PRIORITY_BLOCKING_QUEUE_HPP_
+#define SIMPLELIB_PRIORITY_BLOCKING_QUEUE_HPP_
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#include "common.h"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//Heap entry, FIFO tie-breaking adds an insertion sequence number
+template<typename T, bool FIFO>
+struct PriorityQueueEntry {
+  T value_;
+  uint64_t seq_ = 0;
+};
+
+template<typename T>
+struct PriorityQueueEntry<T, false> {
+  T value_;
+};
+
+//Bounded blocking queue that hands out the highest-priority item first, with
+//the push/pop/timeout/max-size API of SimpleBlockingQueue (PopFront takes the
+//top). Like std::priority_queue, COMP = std::less<T> puts the largest on top.
+//Backed by an ARITY-ary heap in one vector: a 4-ary heap is half as deep as a
+//binary one and, for small T, the children of a node sit in one or two cache
+//lines. With FIFO set, equal items come out in push order.
+template<typename T,
+    typename COMP = std::less<T>,
+    size_t ARITY = 4,
+    bool FIFO = false>
+class PriorityBlockingQueue {
+  static_assert(ARITY >= 2, "heap arity must be at least 2");
+ public:
+  PriorityBlockingQueue() = default;
+  explicit PriorityBlockingQueue(std::uint32_t max_size, const COMP &comp = COMP())
+      : comp_(comp), max_size_(max_size) {}
+  virtual ~PriorityBlockingQueue() = default;
+
+  void PushBack(const T &t) {
+    EmplaceBack(t);
+  }
+
+  void PushBack(T &&t) {
+    EmplaceBack(std::move(t));
+  }
+
+  bool PushBackWithTimeout(const T &t, int timeout/*in milliseconds*/) {
+    return EmplaceBackWithTimeout(timeout, t);
+  }
+
+  bool PushBackWithTimeout(T &&t, int timeout/*in milliseconds*/) {
+    return EmplaceBackWithTimeout(timeout, std::move(t));
+  }
+
+  //Never blocks, returns false if the queue is full
+  bool TryPushBack(const T &t) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (heap_.size() >= max_size_.load()) {
+      return false;
+    }
+    HeapPush(t);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  bool TryPushBack(T &&t) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (heap_.size() >= max_size_.load()) {
+      return false;
+    }
+    HeapPush(std::move(t));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  template<typename... Args>
+  void EmplaceBack(Args &&... args) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    not_full_.wait(locker, [this]() { return heap_.size() < max_size_.load(); });
+    HeapPush(std::forward<Args>(args)...);
+    not_empty_.notify_one();
+  }
+
+  template<typename... Args>
+  bool EmplaceBackWithTimeout(int timeout/*in milliseconds*/, Args &&... args) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    if (not_full_.wait_for(locker,
+                           std::chrono::milliseconds(timeout),
+                           [this]() { return heap_.size() < max_size_.load(); })) {
+      HeapPush(std::forward<Args>(args)...);
+      not_empty_.notify_one();
+      return true;
+    }
+    //timeout
+    return false;
+  }
+
+  void PopFront(T *t) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    not_empty_.wait(locker, [this]() { return !heap_.empty(); });
+    (*t) = HeapPop();
+    not_full_.notify_one();
+  }
+
+  //Blocking pop returning the value, T needs no default constructor
+  T PopFront() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    not_empty_.wait(locker, [this]() { return !heap_.empty(); });
+    T t(HeapPop());
+    not_full_.notify_one();
+    return t;
+  }
+
+  bool PopFrontWithTimeout(T *t, int timeout/*in milliseconds*/) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    if (not_empty_.wait_for(locker,
+                            std::chrono::milliseconds(timeout),
+                            [this]() { return !heap_.empty(); })) {
+      (*t) = HeapPop();
+      not_full_.notify_one();
+      return true;
+    }
+    //timeout
+    return false;
+  }
+
+  //Never blocks, returns false if the queue is empty
+  bool TryPopFront(T *t) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (heap_.empty()) {
+      return false;
+    }
+    (*t) = HeapPop();
+    not_full_.notify_one();
+    return true;
+  }
+
+  //Append the top max_n items to *out in priority order under one lock
+  //acquisition. Blocks until at least one item is available, returns the
+  //number of items moved.
+  size_t PopFrontBatch(std::vector<T> *out, size_t max_n) {
+    if (max_n == 0) {
+      return 0;
+    }
+    std::unique_lock<std::mutex> locker(mutex_);
+    not_empty_.wait(locker, [this]() { return !heap_.empty(); });
+    size_t n = std::min(max_n, heap_.size());
+    for (size_t i = 0; i < n; ++i) {
+      out->push_back(HeapPop());
+    }
+    if (n == 1) {
+      not_full_.notify_one();
+    } else {
+      not_full_.notify_all();
+    }
+    return n;
+  }
+
+  void SetMaxSize(uint32_t max_size) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    max_size_.store(max_size);
+    not_full_.notify_all();
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    heap_.clear();
+    not_full_.notify_all();
+  }
+
+  size_t Size() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return heap_.size();
+  }
+
+  bool Empty() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return heap_.empty();
+  }
+ private:
+  typedef PriorityQueueEntry<T, FIFO> Entry;
+
+  //True if a belongs below b
+  bool Lower(const PriorityQueueEntry<T, true> &a, const PriorityQueueEntry<T, true> &b) {
+    if (comp_(a.value_, b.value_)) {
+      return true;
+    }
+    if (comp_(b.value_, a.value_)) {
+      return false;
+    }
+    return a.seq_ > b.seq_;
+  }
+
+  bool Lower(const PriorityQueueEntry<T, false> &a, const PriorityQueueEntry<T, false> &b) {
+    return comp_(a.value_, b.value_);
+  }
+
+  void Stamp(PriorityQueueEntry<T, true> *e) {
+    e->seq_ = seq_++;
+  }
+
+  void Stamp(PriorityQueueEntry<T, false> *) {}
+
+  template<typename... Args>
+  void HeapPush(Args &&... args) {
+    Entry e{T(std::forward<Args>(args)...)};
+    Stamp(&e);
+    heap_.push_back(std::move(e));
+    size_t hole = heap_.size() - 1;
+    SiftUp(hole, std::move(heap_[hole]));
+  }
+
+  //Move the hole up instead of swapping, then drop moving into it
+  void SiftUp(size_t hole, Entry &&moving_ref) {
+    Entry moving(std::move(moving_ref));
+    Entry *heap = heap_.data();
+    while (hole > 0) {
+      size_t parent = (hole - 1) / ARITY;
+      if (!Lower(heap[parent], moving)) {
+        break;
+      }
+      heap[hole] = std::move(heap[parent]);
+      hole = parent;
+    }
+    heap[hole] = std::move(moving);
+  }
+
+  //Bottom-up pop: walk the hole at the root down along the best children to a
+  //leaf without comparing against the last entry, which almost always belongs
+  //near the bottom, then sift that entry up from there
+  T HeapPop() {
+    T top(std::move(heap_.front().value_));
+    Entry moving(std::move(heap_.back()));
+    heap_.pop_back();
+    size_t n = heap_.size();
+    if (n > 0) {
+      Entry *heap = heap_.data();
+      size_t hole = 0;
+      for (;;) {
+        size_t first = hole * ARITY + 1;
+        if (first >= n) {
+          break;
+        }
+        size_t last = std::min(first + ARITY, n);
+        size_t best = first;
+        for (size_t c = first + 1; c < last; ++c) {
+          //Unpredictable, keep it a conditional move
+          best = Lower(heap[best], heap[c]) ? c : best;
+        }
+        heap[hole] = std::move(heap[best]);
+        hole = best;
+      }
+      SiftUp(hole, std::move(moving));
+    }
+    return top;
+  }
+
+  COMP comp_;
+  std::vector<Entry> heap_;
+  uint64_t seq_ = 0;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::atomic<uint32_t> max_size_{std::numeric_limits<std::uint32_t>::max()};
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif // SIMPLELIB_PRIORITY_BLOCKING_QUEUE_HPP_
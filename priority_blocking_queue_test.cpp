@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+#include <functional>
+#include "gtest/gtest.h"
+#include "priority_blocking_queue.hpp"
+
+using namespace simplelib;
+
+//Random pushes and pops checked against std::priority_queue
+template <size_t ARITY, typename COMP>
+void RunOracle(unsigned seed) {
+    PriorityBlockingQueue<int, COMP, ARITY> queue;
+    std::priority_queue<int, std::vector<int>, COMP> oracle;
+    std::mt19937 rng(seed);
+    for (int i = 0; i < 20000; i++) {
+        if (oracle.empty() || rng() % 3 != 0) {
+            int v = static_cast<int>(rng() % 1000);
+            queue.PushBack(v);
+            oracle.push(v);
+        } else {
+            int t = -1;
+            ASSERT_TRUE(queue.TryPopFront(&t));
+            ASSERT_EQ(oracle.top(), t);
+            oracle.pop();
+        }
+        ASSERT_EQ(oracle.size(), queue.Size());
+    }
+    while (!oracle.empty()) {
+        ASSERT_EQ(oracle.top(), queue.PopFront());
+        oracle.pop();
+    }
+    ASSERT_TRUE(queue.Empty());
+}
+
+TEST(PriorityBlockingQueueTest, Test_Heap_Oracle) {
+    RunOracle<2, std::less<int>>(1);
+    RunOracle<4, std::less<int>>(2);
+    RunOracle<8, std::less<int>>(3);
+    RunOracle<2, std::greater<int>>(4);
+    RunOracle<4, std::greater<int>>(5);
+    RunOracle<8, std::greater<int>>(6);
+}
+
+//Ordered by key only, id records the push order
+struct Job {
+    int key;
+    int id;
+};
+
+struct JobLess {
+    bool operator()(const Job &a, const Job &b) const {
+        return a.key < b.key;
+    }
+};
+
+template <size_t ARITY>
+void RunFifo() {
+    PriorityBlockingQueue<Job, JobLess, ARITY, true> queue;
+    std::mt19937 rng(ARITY);
+    int id = 0;
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 200; i++) {
+            queue.PushBack(Job{static_cast<int>(rng() % 4), id++});
+        }
+        //Drain half, then keep pushing on top of the rest
+        Job last = queue.PopFront();
+        for (int i = 1; i < 100; i++) {
+            Job job = queue.PopFront();
+            ASSERT_LE(job.key, last.key);
+            if (job.key == last.key) {
+                ASSERT_GT(job.id, last.id);
+            }
+            last = job;
+        }
+    }
+    Job last = queue.PopFront();
+    while (!queue.Empty()) {
+        Job job = queue.PopFront();
+        ASSERT_LE(job.key, last.key);
+        if (job.key == last.key) {
+            ASSERT_GT(job.id, last.id);
+        }
+        last = job;
+    }
+}
+
+TEST(PriorityBlockingQueueTest, Test_Fifo_Ties) {
+    RunFifo<2>();
+    RunFifo<4>();
+    RunFifo<8>();
+}
+
+TEST(PriorityBlockingQueueTest, Test_Pop_Batch) {
+    PriorityBlockingQueue<int> queue;
+    std::vector<int> values;
+    for (int i = 0; i < 100; i++) {
+        values.push_back(i);
+    }
+    std::shuffle(values.begin(), values.end(), std::mt19937(7));
+    for (int v : values) {
+        queue.PushBack(v);
+    }
+
+    std::vector<int> out;
+    ASSERT_EQ(0u, queue.PopFrontBatch(&out, 0));
+    ASSERT_EQ(10u, queue.PopFrontBatch(&out, 10));
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(99 - i, out[i]);
+    }
+    ASSERT_EQ(90u, queue.Size());
+
+    //Appends, and stops at what is there
+    ASSERT_EQ(90u, queue.PopFrontBatch(&out, 1000));
+    ASSERT_EQ(100u, out.size());
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(99 - i, out[i]);
+    }
+    ASSERT_TRUE(queue.Empty());
+}
+
+TEST(PriorityBlockingQueueTest, Test_Max_Size) {
+    PriorityBlockingQueue<int> queue(2);
+    queue.PushBack(1);
+    queue.PushBack(2);
+    ASSERT_FALSE(queue.TryPushBack(3));
+    ASSERT_FALSE(queue.PushBackWithTimeout(3, 10));
+
+    //A pop lets one blocked pusher in
+    std::atomic<int> pushed(0);
+    std::thread pusher([&queue, &pushed]() {
+        queue.PushBack(3);
+        pushed++;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(0, pushed.load());
+    ASSERT_EQ(2, queue.PopFront());
+    pusher.join();
+    ASSERT_EQ(1, pushed.load());
+    ASSERT_EQ(2u, queue.Size());
+
+    //A batch pop frees room for several
+    std::vector<std::thread> pushers;
+    for (int i = 0; i < 2; i++) {
+        pushers.emplace_back([&queue, &pushed, i]() {
+            queue.PushBack(10 + i);
+            pushed++;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(1, pushed.load());
+    std::vector<int> out;
+    ASSERT_EQ(2u, queue.PopFrontBatch(&out, 2));
+    for (auto &t : pushers) {
+        t.join();
+    }
+    ASSERT_EQ(3, pushed.load());
+
+    //Raising the bound wakes a blocked pusher
+    std::thread raised([&queue, &pushed]() {
+        queue.PushBack(20);
+        pushed++;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(3, pushed.load());
+    queue.SetMaxSize(3);
+    raised.join();
+    ASSERT_EQ(3u, queue.Size());
+    ASSERT_EQ(20, queue.PopFront());
+    ASSERT_EQ(11, queue.PopFront());
+    ASSERT_EQ(10, queue.PopFront());
+    int t = 0;
+    ASSERT_FALSE(queue.PopFrontWithTimeout(&t, 10));
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    // Runs all tests using Google Test.
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,114 @@
+#ifndef SIMPLELIB_QUEUE_SELECTOR_HPP_
+#define SIMPLELIB_QUEUE_SELECTOR_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include "common.h"
+#include "futex.hpp"
+#include "simple_blocking_queue.hpp"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//Blocks a thread until any of a set of queues has an item, like select(2) for
+//SimpleBlockingQueue. Every queue signals one shared EventCount on push, so a
+//waiting dispatcher costs no polling and no per-queue condition variable.
+//
+//kPriority always drains the queue added first before looking at later ones,
+//kRoundRobin starts each scan after the queue served last.
+//
+//Add all queues before popping. A queue reports to one selector at a time and
+//must outlive it; the destructor detaches the queues.
+template<typename T, typename QUEUE = SimpleBlockingQueue<T>>
+class QueueSelector {
+ public:
+  enum Policy {
+    kPriority,
+    kRoundRobin,
+  };
+
+  explicit QueueSelector(Policy policy = kRoundRobin) : policy_(policy) {}
+  virtual ~QueueSelector() {
+    for (QUEUE *queue : queues_) {
+      queue->SetNotifier(nullptr, nullptr);
+    }
+  }
+
+  QueueSelector(const QueueSelector &) = delete;
+  QueueSelector &operator=(const QueueSelector &) = delete;
+
+  //Returns the index of queue, which is also its rank under kPriority
+  size_t Add(QUEUE *queue) {
+    queues_.push_back(queue);
+    queue->SetNotifier(&event_, &NotifyEvent);
+    return queues_.size() - 1;
+  }
+
+  //Pop from the first non-empty queue, blocking until there is one.
+  //Returns the index of the queue the item came from.
+  size_t PopFront(T *t) {
+    size_t index = 0;
+    while (!TryPopFront(t, &index)) {
+      uint32_t key = event_.PrepareWait();
+      if (TryPopFront(t, &index)) {
+        event_.CancelWait();
+        break;
+      }
+      event_.Wait(key);
+    }
+    return index;
+  }
+
+  bool PopFrontWithTimeout(T *t, int timeout/*in milliseconds*/, size_t *index = nullptr) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (!TryPopFront(t, index)) {
+      uint32_t key = event_.PrepareWait();
+      if (TryPopFront(t, index)) {
+        event_.CancelWait();
+        break;
+      }
+      if (!event_.WaitFor(key, deadline - std::chrono::steady_clock::now())) {
+        //timeout
+        return TryPopFront(t, index);
+      }
+    }
+    return true;
+  }
+
+  //Never blocks, returns false if every queue is empty
+  bool TryPopFront(T *t, size_t *index = nullptr) {
+    size_t n = queues_.size();
+    size_t start = policy_ == kRoundRobin ? next_.load(std::memory_order_relaxed) : 0;
+    for (size_t i = 0; i < n; ++i) {
+      size_t q = start + i < n ? start + i : start + i - n;
+      if (queues_[q]->TryPopFront(t)) {
+        if (policy_ == kRoundRobin) {
+          next_.store(q + 1 < n ? q + 1 : 0, std::memory_order_relaxed);
+        }
+        if (index != nullptr) {
+          *index = q;
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t Size() {
+    return queues_.size();
+  }
+ private:
+  static void NotifyEvent(void *event, int n) {
+    static_cast<EventCount *>(event)->Notify(n);
+  }
+
+  Policy policy_;
+  std::vector<QUEUE *> queues_;
+  EventCount event_;
+  std::atomic<size_t> next_{0};
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif // SIMPLELIB_QUEUE_SELECTOR_HPP_
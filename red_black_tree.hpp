@@ -1,37 +1,132 @@
 #ifndef SIMPLELIB_RED_BLACK_TREE_HPP_
 #define SIMPLELIB_RED_BLACK_TREE_HPP_
 
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <future>
+#include <utility>
+#include <iterator>
 #include <functional>
+#include <type_traits>
 #include "common.h"
+#include "node_allocator.hpp"
 
 BEGIN_NAMESPACE_SIMPLELIB
 
+//Augmentation policies of RedBlackTree. A policy provides:
+//    NodeBase<Key>              extra data carried by every node, as a base class
+//    kEnabled                   false skips all the bookkeeping at compile time
+//    update(Node *node, nil)    recompute the data of node from its children,
+//                               nil is the sentinel and is never updated
+//The tree calls update on every node whose subtree changes: both nodes of a
+//rotation and the path to the root after an insertion or a deletion.
+
+//No augmentation, nodes stay as small as possible
+struct RedBlackTreeNoAugment {
+    template <typename Key>
+    struct NodeBase {};
+
+    static constexpr bool kEnabled = false;
+
+    template <typename Node>
+    static void update(Node *, const Node *) {}
+};
+
+//Subtree sizes, enables select() and rank()
+struct RedBlackTreeOrderStatistic {
+    template <typename Key>
+    struct NodeBase {
+        uint32_t _count = 0;
+    };
+
+    static constexpr bool kEnabled = true;
+
+    template <typename Node>
+    static void update(Node *node, const Node *) {
+        node->_count = node->_left->_count + node->_right->_count + 1;
+    }
+};
+
+//Interval tree: Key is a closed interval std::pair(lo, hi) with lo <= hi,
+//ordered by lo then hi. Every node keeps the greatest hi of its subtree,
+//which enables overlapping().
+struct RedBlackTreeIntervalAugment {
+    template <typename Key>
+    struct NodeBase {
+        typename Key::second_type _max = typename Key::second_type();
+    };
+
+    static constexpr bool kEnabled = true;
+
+    template <typename Node>
+    static void update(Node *node, const Node *nil) {
+        node->_max = node->_k.second;
+        if (node->_left != nil && node->_max < node->_left->_max) {
+            node->_max = node->_left->_max;
+        }
+        if (node->_right != nil && node->_max < node->_right->_max) {
+            node->_max = node->_right->_max;
+        }
+    }
+};
+
 //The red-black tree
-template <typename Key, typename Value, typename Comp = std::less<Key>>
+//Alloc is the node allocation policy, see node_allocator.hpp
+//Augment is the augmentation policy, see above
+template <typename Key, typename Value, typename Comp = std::less<Key>,
+          template <typename> class Alloc = NewNodeAllocator,
+          typename Augment = RedBlackTreeNoAugment>
 class RedBlackTree {
+    //Reads the nodes optimistically under its own sequence lock
+    template <typename, typename, typename> friend class ConcurrentRedBlackTree;
+
 private:
 //************************* Internal structures ******************************
 
     //Internal enum class Color, user won't care about this
-    enum class Color { RED, BLACK };
+    //BLACK is 0, so a zero filled node is a valid black sentinel
+    enum class Color : uintptr_t { BLACK = 0, RED = 1 };
 
     //Internal struct Node, user won't care about this
-    struct Node {
+    //The color is packed into the lowest bit of the parent pointer
+    struct Node : public Augment::template NodeBase<Key> {
         //Default constructor used by sentinel
-        Node(): _c(Color::BLACK) {}
+        Node(): _parent_color(static_cast<uintptr_t>(Color::BLACK)) {}
+
+        //Constructor used by insert node, the value is constructed from args
+        template <typename K, typename ...Args>
+        explicit Node(K &&key, Args&&... args)
+            : _k(std::forward<K>(key)), _v(std::forward<Args>(args)...) {}
 
-        //Constructor used by insert node
-        Node(const Key &key, const Value &value): _k(key), _v(value) {}
+        Node * parent() const {
+            return reinterpret_cast<Node *>(_parent_color & ~kColorMask);
+        }
+
+        void set_parent(Node *parent) {
+            _parent_color = reinterpret_cast<uintptr_t>(parent) | (_parent_color & kColorMask);
+        }
+
+        Color color() const {
+            return static_cast<Color>(_parent_color & kColorMask);
+        }
+
+        void set_color(Color c) {
+            _parent_color = (_parent_color & ~kColorMask) | static_cast<uintptr_t>(c);
+        }
+
+        static constexpr uintptr_t kColorMask = 1;
 
         //Data area
         Key _k = Key();
         Value _v = Value();
-        Color _c = Color::RED;
         Node *_left = nullptr;
         Node *_right = nullptr;
-        Node *_parent = nullptr;
+        uintptr_t _parent_color = static_cast<uintptr_t>(Color::RED);
     };
 
+    static_assert(alignof(Node) > 1, "The lowest bit of a node pointer must be free");
+
 //******************************* Rotations **********************************
 
     //Left rotate:
@@ -45,18 +140,21 @@ private:
         Node *temp = node->_right;
         node->_right = temp->_left;
         if (temp->_left != _sentinel) {
-            temp->_left->_parent = node;
+            temp->_left->set_parent(node);
         }
-        temp->_parent = node->_parent;
-        if (node->_parent == _sentinel) {
+        temp->set_parent(node->parent());
+        if (node->parent() == _sentinel) {
             _root = temp;
-        } else if (node == node->_parent->_left) {
-            node->_parent->_left = temp;
+        } else if (node == node->parent()->_left) {
+            node->parent()->_left = temp;
         } else {
-            node->_parent->_right = temp;
+            node->parent()->_right = temp;
         }
         temp->_left = node;
-        node->_parent = temp;
+        node->set_parent(temp);
+
+        Augment::update(node, _sentinel);
+        Augment::update(temp, _sentinel);
     }
 
     //Right rotate:
@@ -70,18 +168,33 @@ private:
         Node *temp = node->_left;
         node->_left = temp->_right;
         if (temp->_right != _sentinel) {
-            temp->_right->_parent = node;
+            temp->_right->set_parent(node);
         }
-        temp->_parent = node->_parent;
-        if (node->_parent == _sentinel) {
+        temp->set_parent(node->parent());
+        if (node->parent() == _sentinel) {
             _root = temp;
-        } else if (node == node->_parent->_left) {
-            node->_parent->_left = temp;
+        } else if (node == node->parent()->_left) {
+            node->parent()->_left = temp;
         } else {
-            node->_parent->_right = temp;
+            node->parent()->_right = temp;
         }
         temp->_right = node;
-        node->_parent = temp;
+        node->set_parent(temp);
+
+        Augment::update(node, _sentinel);
+        Augment::update(temp, _sentinel);
+    }
+
+//**************************** Augmentation **********************************
+
+    //Recompute the augmented data from node up to the root
+    void augment_path(Node *node) {
+        if (Augment::kEnabled) {
+            while (node != _sentinel) {
+                Augment::update(node, _sentinel);
+                node = node->parent();
+            }
+        }
     }
 
 //***************************** Insertion ************************************
@@ -120,47 +233,50 @@ private:
     //
     //
     void insert_fixup(Node *node) {
-        while (node->_parent->_c == Color::RED) {
-            if (node->_parent == node->_parent->_parent->_left) {
-                Node *temp = node->_parent->_parent->_right;
-                if (temp->_c == Color::RED) {                 //case 1
-                    node->_parent->_c = Color::BLACK;
-                    temp->_c = Color::BLACK;
-                    node->_parent->_parent->_c = Color::RED;
-                    node = node->_parent->_parent;
+        while (node->parent()->color() == Color::RED) {
+            if (node->parent() == node->parent()->parent()->_left) {
+                Node *temp = node->parent()->parent()->_right;
+                if (temp->color() == Color::RED) {                 //case 1
+                    node->parent()->set_color(Color::BLACK);
+                    temp->set_color(Color::BLACK);
+                    node->parent()->parent()->set_color(Color::RED);
+                    node = node->parent()->parent();
                 } else {
-                    if (node == node->_parent->_right) {      //case 2
-                        node = node->_parent;
+                    if (node == node->parent()->_right) {      //case 2
+                        node = node->parent();
                         left_rotate(node);
                     }
-                    node->_parent->_c = Color::BLACK;         //case 3
-                    node->_parent->_parent->_c = Color::RED;
-                    right_rotate(node->_parent->_parent);
+                    node->parent()->set_color(Color::BLACK);         //case 3
+                    node->parent()->parent()->set_color(Color::RED);
+                    right_rotate(node->parent()->parent());
                 }
             } else {
-                Node *temp = node->_parent->_parent->_left;
-                if (temp->_c == Color::RED) {                 //case 4
-                    node->_parent->_c = Color::BLACK;
-                    temp->_c = Color::BLACK;
-                    node->_parent->_parent->_c = Color::RED;
-                    node = node->_parent->_parent;
+                Node *temp = node->parent()->parent()->_left;
+                if (temp->color() == Color::RED) {                 //case 4
+                    node->parent()->set_color(Color::BLACK);
+                    temp->set_color(Color::BLACK);
+                    node->parent()->parent()->set_color(Color::RED);
+                    node = node->parent()->parent();
                 } else {
-                    if (node == node->_parent->_left) {       //case 5
-                        node = node->_parent;
+                    if (node == node->parent()->_left) {       //case 5
+                        node = node->parent();
                         right_rotate(node);
                     }
-                    node->_parent->_c = Color::BLACK;         //case 6
-                    node->_parent->_parent->_c = Color::RED;
-                    left_rotate(node->_parent->_parent);
+                    node->parent()->set_color(Color::BLACK);         //case 6
+                    node->parent()->parent()->set_color(Color::RED);
+                    left_rotate(node->parent()->parent());
                 }
             }
         }
-        _root->_c = Color::BLACK;
+        //Only a red root adds a black level
+        if (_root->color() == Color::RED) {
+            _root->set_color(Color::BLACK);
+            _black_height++;
+        }
     }
 
-    void inner_insert(const Key& k, const Value& v, Node *parent) {
-        Node *node = new Node(k, v);
-
+    //Link a newly created node under parent, which comes from inner_find
+    void inner_insert(Node *node, Node *parent) {
         if (parent == _sentinel) {
             _root = node;
         } else if (_comp(node->_k, parent->_k)) {
@@ -172,25 +288,51 @@ private:
         //Assign sentinels
         node->_left = _sentinel;
         node->_right = _sentinel;
-        node->_parent = parent;
+        node->set_parent(parent);
 
+        augment_path(node);
         insert_fixup(node);
     }
 
-//******************************* Successor **********************************
+//************************** Successor/Predecessor ***************************
+
+    Node * minimum(Node *node) const {
+        while (node->_left != _sentinel) {
+            node = node->_left;
+        }
+        return node;
+    }
+
+    Node * maximum(Node *node) const {
+        while (node->_right != _sentinel) {
+            node = node->_right;
+        }
+        return node;
+    }
 
-    Node * successor(Node *node) {
+    Node * successor(Node *node) const {
         Node *ret = _sentinel;
         if (node->_right != _sentinel) {
-            ret = node->_right;
-            while (ret->_left != _sentinel) {
-                ret = ret->_left;
-            }
+            ret = minimum(node->_right);
         } else {
-            ret = node->_parent;
+            ret = node->parent();
             while (ret != _sentinel && node == ret->_right) {
                 node = ret;
-                ret = ret->_parent;
+                ret = ret->parent();
+            }
+        }
+        return ret;
+    }
+
+    Node * predecessor(Node *node) const {
+        Node *ret = _sentinel;
+        if (node->_left != _sentinel) {
+            ret = maximum(node->_left);
+        } else {
+            ret = node->parent();
+            while (ret != _sentinel && node == ret->_left) {
+                node = ret;
+                ret = ret->parent();
             }
         }
         return ret;
@@ -198,21 +340,88 @@ private:
 
 //******************************* Finder *************************************
 
-    //Finder: return the position for insertion if the key does not exist
-    Node * inner_find(const Key &k) {
-        Node *temp = _root;
+    //Number of lookups find_batch keeps in flight
+    static constexpr std::size_t kBatchWidth = 16;
+
+    //Whether C::is_transparent exists, i.e. C compares keys of other types
+    template <typename C>
+    static std::true_type is_transparent(typename C::is_transparent *);
+
+    template <typename C>
+    static std::false_type is_transparent(...);
+
+    //k can be compared against the keys as is
+    template <typename K, typename ...Args>
+    bool try_emplace_key(std::true_type, K&& k, Args&&... args) {
         Node *parent = _sentinel;
+        if (inner_find(k, &parent) != _sentinel) {
+            return false;
+        }
+
+        inner_insert(_alloc.create(std::forward<K>(k), std::forward<Args>(args)...), parent);
+        _size++;
+
+        return true;
+    }
+
+    //Otherwise every comparison would convert k again
+    template <typename K, typename ...Args>
+    bool try_emplace_key(std::false_type, K&& k, Args&&... args) {
+        return try_emplace_key(std::true_type(), Key(std::forward<K>(k)), std::forward<Args>(args)...);
+    }
+
+    //Finder: return the node equivalent to k, or the sentinel if k does not
+    //exist, in which case *parent is set to the position for insertion.
+    //K differs from Key only for heterogeneous lookup with a transparent Comp.
+    template <typename K>
+    Node * inner_find(const K &k, Node **parent = nullptr) {
+        Node *temp = _root;
+        Node *last = _sentinel;
         while (temp != _sentinel) {
-            parent = temp;
             if (_comp(k, temp->_k)) {
+                last = temp;
                 temp = temp->_left;
             } else if (_comp(temp->_k, k)) {
+                last = temp;
                 temp = temp->_right;
             } else {
-                break;
+                return temp;
             }
         }
-        return parent;
+        if (parent != nullptr) {
+            *parent = last;
+        }
+        return _sentinel;
+    }
+
+    //The first node whose key is not less than k
+    Node * inner_lower_bound(const Key &k) const {
+        Node *temp = _root;
+        Node *ret = _sentinel;
+        while (temp != _sentinel) {
+            if (!_comp(temp->_k, k)) {
+                ret = temp;
+                temp = temp->_left;
+            } else {
+                temp = temp->_right;
+            }
+        }
+        return ret;
+    }
+
+    //The first node whose key is greater than k
+    Node * inner_upper_bound(const Key &k) const {
+        Node *temp = _root;
+        Node *ret = _sentinel;
+        while (temp != _sentinel) {
+            if (_comp(k, temp->_k)) {
+                ret = temp;
+                temp = temp->_left;
+            } else {
+                temp = temp->_right;
+            }
+        }
+        return ret;
     }
 
 //******************************* Deletion ***********************************
@@ -256,111 +465,486 @@ private:
     //          y(c')        z(R)       node(B)     y(c')
     //
 
-    void delete_fixup(Node *node) {
+    //node may be the sentinel, so its parent is passed along instead of being
+    //stored into the shared sentinel
+    void delete_fixup(Node *node, Node *parent) {
         Node *temp = nullptr;
-        while (node != _root && node->_c == Color::BLACK) {
-            if (node == node->_parent->_left) {
-                temp = node->_parent->_right;
-                if (temp->_c == Color::RED) {               //case 1
-                    temp->_c = Color::BLACK;
-                    node->_parent->_c = Color::RED;
-                    left_rotate(node->_parent);
-                    temp = node->_parent->_right;
+        while (node != _root && node->color() == Color::BLACK) {
+            if (node == parent->_left) {
+                temp = parent->_right;
+                if (temp->color() == Color::RED) {               //case 1
+                    temp->set_color(Color::BLACK);
+                    parent->set_color(Color::RED);
+                    left_rotate(parent);
+                    temp = parent->_right;
                 }
-                if (temp->_left->_c == Color::BLACK &&
-                    temp->_right->_c == Color::BLACK) {     //case 2
-                    temp->_c = Color::RED;
-                    node = node->_parent;
+                if (temp->_left->color() == Color::BLACK &&
+                    temp->_right->color() == Color::BLACK) {     //case 2
+                    temp->set_color(Color::RED);
+                    node = parent;
+                    parent = node->parent();
                 } else {
-                    if (temp->_right->_c == Color::BLACK) { //case 3
-                        temp->_left->_c = Color::BLACK;
-                        temp->_c = Color::RED;
+                    if (temp->_right->color() == Color::BLACK) { //case 3
+                        temp->_left->set_color(Color::BLACK);
+                        temp->set_color(Color::RED);
                         right_rotate(temp);
-                        temp = node->_parent->_right;
+                        temp = parent->_right;
                     }
-                    if (temp == _sentinel) {
-                        printf("here");
-                    }
-                    temp->_c = node->_parent->_c;           //case 4
-                    node->_parent->_c = Color::BLACK;
-                    temp->_right->_c = Color::BLACK;
-                    left_rotate(node->_parent);
-                    node = _root;
+                    temp->set_color(parent->color());            //case 4
+                    parent->set_color(Color::BLACK);
+                    temp->_right->set_color(Color::BLACK);
+                    left_rotate(parent);
+                    return;
                 }
             } else {
-                temp = node->_parent->_left;
-                if (temp->_c == Color::RED) {               //case 5
-                    temp->_c = Color::BLACK;
-                    node->_parent->_c = Color::RED;
-                    right_rotate(node->_parent);
-                    temp = node->_parent->_left;
+                temp = parent->_left;
+                if (temp->color() == Color::RED) {               //case 5
+                    temp->set_color(Color::BLACK);
+                    parent->set_color(Color::RED);
+                    right_rotate(parent);
+                    temp = parent->_left;
                 }
-                if (temp->_left->_c == Color::BLACK &&
-                    temp->_right->_c == Color::BLACK) {     //case 6
-                    temp->_c = Color::RED;
-                    node = node->_parent;
+                if (temp->_left->color() == Color::BLACK &&
+                    temp->_right->color() == Color::BLACK) {     //case 6
+                    temp->set_color(Color::RED);
+                    node = parent;
+                    parent = node->parent();
                 } else {
-                    if (temp->_left->_c == Color::BLACK) {  //case 7
-                        temp->_right->_c = Color::BLACK;
-                        temp->_c = Color::RED;
+                    if (temp->_left->color() == Color::BLACK) {  //case 7
+                        temp->_right->set_color(Color::BLACK);
+                        temp->set_color(Color::RED);
                         left_rotate(temp);
-                        temp = node->_parent->_left;
+                        temp = parent->_left;
                     }
-                    temp->_c = node->_parent->_c;           //case 8
-                    node->_parent->_c = Color::BLACK;
-                    temp->_left->_c = Color::BLACK;
-                    right_rotate(node->_parent);
-                    node = _root;
+                    temp->set_color(parent->color());            //case 8
+                    parent->set_color(Color::BLACK);
+                    temp->_left->set_color(Color::BLACK);
+                    right_rotate(parent);
+                    return;
                 }
             }
         }
-        node->_c = Color::BLACK;
+        if (node->color() == Color::RED) {
+            node->set_color(Color::BLACK);
+        } else {
+            //The extra black reached the root and is dropped
+            _black_height--;
+        }
     }
 
-    void inner_delete(Node *node) {
-        //Find the node p to be deleted
-        Node *p = _sentinel;
-        if (node->_left == _sentinel || node->_right == _sentinel) {
-            p = node;
+    //Replace the subtree rooted at u by the one rooted at v
+    void transplant(Node *u, Node *v) {
+        if (u->parent() == _sentinel) {
+            _root = v;
+        } else if (u == u->parent()->_left) {
+            u->parent()->_left = v;
         } else {
-            p = successor(node);
+            u->parent()->_right = v;
+        }
+        if (v != _sentinel) {
+            v->set_parent(u->parent());
         }
+    }
+
+    //Unlink node from the tree without freeing it. A node with two children is
+    //replaced by its successor p, which is relinked into its place instead of
+    //copying the key/value, so no payload is copied and other nodes never move.
+    void inner_unlink(Node *node) {
+        Node *p = node;
+        Color removed = p->color();
 
-        //Modify nodes around p
+        //q takes the position left by p and carries the extra black,
+        //q_parent is tracked apart as q may be the sentinel
         Node *q = _sentinel;
-        if (p->_left != _sentinel) {
-            q = p->_left;
+        Node *q_parent = node->parent();
+        if (node->_left == _sentinel) {
+            q = node->_right;
+            transplant(node, node->_right);
+        } else if (node->_right == _sentinel) {
+            q = node->_left;
+            transplant(node, node->_left);
         } else {
+            p = minimum(node->_right);
+            removed = p->color();
             q = p->_right;
+            if (p->parent() == node) {
+                q_parent = p;
+            } else {
+                q_parent = p->parent();
+                transplant(p, p->_right);
+                p->_right = node->_right;
+                p->_right->set_parent(p);
+            }
+            transplant(node, p);
+            p->_left = node->_left;
+            p->_left->set_parent(p);
+            p->set_color(node->color());
+        }
+
+        augment_path(q_parent);
+
+        if (removed == Color::BLACK) {
+            delete_fixup(q, q_parent);
+        }
+    }
+
+    void inner_delete(Node *node) {
+        inner_unlink(node);
+        _alloc.destroy(node);
+    }
+
+//****************************** Bulk load ***********************************
+
+    //Build a perfectly balanced subtree out of the next n items of it.
+    //Nodes are created in key order, so a reserved pool keeps them contiguous.
+    //The left subtree takes (n - 1) / 2 items, so subtree sizes differ by at
+    //most one and every link to the sentinel sits at depth red_depth or below.
+    //Painting the nodes at red_depth red thus balances all black heights.
+    template <typename Iterator>
+    Node * inner_build(Iterator &it, std::size_t n, int depth, int red_depth) {
+        if (n == 0) {
+            return _sentinel;
+        }
+
+        Node *left = inner_build(it, (n - 1) / 2, depth + 1, red_depth);
+        Node *node = _alloc.create((*it).first, (*it).second);
+        ++it;
+        Node *right = inner_build(it, n / 2, depth + 1, red_depth);
+
+        node->set_color(depth == red_depth ? Color::RED : Color::BLACK);
+        node->_left = left;
+        node->_right = right;
+        node->set_parent(_sentinel);
+        if (left != _sentinel) {
+            left->set_parent(node);
+        }
+        if (right != _sentinel) {
+            right->set_parent(node);
+        }
+        Augment::update(node, _sentinel);
+        return node;
+    }
+
+//*************************** Join and split *********************************
+    //Join based set operations, see "Just Join for Parallel Ordered Sets"
+    //by Blelloch et al. Subtrees are carried around as temporary trees, which
+    //is free as the sentinel is shared and the allocator is stateless.
+
+    //Black nodes on the way from node down to the sentinel, O(log n).
+    //Trees keep it in _black_height, so only bulk_load walks it.
+    int black_height(Node *node) const {
+        int h = 0;
+        for (; node != _sentinel; node = node->_left) {
+            if (node->color() == Color::BLACK) {
+                h++;
+            }
+        }
+        return h;
+    }
+
+    //Make the detached subtree rooted at node, whose black height is height,
+    //the content of this tree. A red node gains a black level as the root.
+    void set_root(Node *node, int height) {
+        _root = node;
+        _black_height = height;
+        if (node != _sentinel) {
+            node->set_parent(_sentinel);
+            if (node->color() == Color::RED) {
+                node->set_color(Color::BLACK);
+                _black_height++;
+            }
+        }
+    }
+
+    //Take over the content of other, which is left empty
+    void take_root(RedBlackTree *other) {
+        _root = other->_root;
+        _black_height = other->_black_height;
+        other->_root = _sentinel;
+        other->_black_height = 0;
+    }
+
+    //Join this tree, mid and right into this tree, right is left empty.
+    //Keys of this tree < mid < keys of right. mid is linked as a red node
+    //right above the black node of the taller tree's inner spine whose black
+    //height equals the shorter tree's, then insert_fixup repairs the colors.
+    //Both black heights are kept by the trees, so it costs O(difference of
+    //black heights), or O(log n) if one side is empty.
+    void inner_join(Node *mid, RedBlackTree *right) {
+        Node *r = right->_root;
+        int left_height = _black_height;
+        int right_height = right->_black_height;
+        right->_root = _sentinel;
+        right->_black_height = 0;
+        mid->set_color(Color::RED);
+        if (r == _sentinel) {
+            inner_insert(mid, _root == _sentinel ? _sentinel : maximum(_root));
+            return;
+        }
+        if (_root == _sentinel) {
+            _root = r;
+            _black_height = right_height;
+            inner_insert(mid, minimum(r));
+            return;
+        }
+
+        //Roots are always black and mid is linked red, so the taller height
+        //holds until insert_fixup recolors the root
+        if (left_height >= right_height) {
+            Node *y = _root;
+            for (int h = left_height; y->color() == Color::RED || h != right_height; y = y->_right) {
+                if (y->color() == Color::BLACK) {
+                    h--;
+                }
+            }
+            Node *parent = y->parent();
+            mid->_left = y;
+            mid->_right = r;
+            mid->set_parent(parent);
+            if (parent == _sentinel) {
+                _root = mid;
+            } else {
+                parent->_right = mid;
+            }
+        } else {
+            Node *y = r;
+            for (int h = right_height; y->color() == Color::RED || h != left_height; y = y->_left) {
+                if (y->color() == Color::BLACK) {
+                    h--;
+                }
+            }
+            Node *parent = y->parent();
+            _black_height = right_height;
+            mid->_left = _root;
+            mid->_right = y;
+            mid->set_parent(parent);
+            if (parent == _sentinel) {
+                _root = mid;
+            } else {
+                parent->_left = mid;
+                _root = r;
+            }
+        }
+        mid->_left->set_parent(mid);
+        mid->_right->set_parent(mid);
+
+        augment_path(mid);
+        insert_fixup(mid);
+    }
+
+    //Join without a middle node, the minimum of right is taken out instead
+    void inner_join(RedBlackTree *right) {
+        if (right->_root == _sentinel) {
+            return;
+        }
+        if (_root == _sentinel) {
+            take_root(right);
+            return;
+        }
+        Node *mid = minimum(right->_root);
+        right->inner_unlink(mid);
+        inner_join(mid, right);
+    }
+
+    //Split this tree by k: keys less than k stay, keys greater than k move
+    //into right, which must be empty. The node equal to k is returned
+    //detached, or the sentinel if k does not exist. The joins on the way
+    //back up cost O(difference of black heights) each, which sums up to
+    //O(log n).
+    Node * inner_split(const Key &k, RedBlackTree *right) {
+        if (_root == _sentinel) {
+            return _sentinel;
+        }
+
+        //The root is black, so its children are one black level lower
+        Node *m = _root;
+        int height = _black_height - 1;
+        RedBlackTree rest;
+        if (_comp(k, m->_k)) {
+            rest.set_root(m->_right, height);
+            set_root(m->_left, height);
+            Node *found = inner_split(k, right);
+            right->inner_join(m, &rest);
+            return found;
+        } else if (_comp(m->_k, k)) {
+            rest.set_root(m->_left, height);
+            set_root(m->_right, height);
+            Node *found = inner_split(k, right);
+            rest.inner_join(m, this);
+            take_root(&rest);
+            return found;
+        }
+        set_root(m->_left, height);
+        right->set_root(m->_right, height);
+        return m;
+    }
+
+    //Run first() here and second() on another thread if parallel is set,
+    //returns the sum of both results
+    template <typename First, typename Second>
+    static std::size_t fork_join(bool parallel, First first, Second second) {
+        if (!parallel) {
+            return first() + second();
+        }
+        std::future<std::size_t> future = std::async(std::launch::async, second);
+        std::size_t ret = first();
+        return ret + future.get();
+    }
+
+    //The halves of a set operation are forked while the exposed subtree
+    //holds at least 2^kParallelBlackHeight - 1 nodes and forks remain
+    static constexpr int kParallelBlackHeight = 10;
+
+    //Fork levels for set operations: twice as many tasks as hardware threads
+    static int parallel_levels() {
+        int levels = 1;
+        for (unsigned n = std::thread::hardware_concurrency(); n > 1; n >>= 1) {
+            levels++;
+        }
+        return levels;
+    }
+
+    //Split other by its root m and this tree by m's key, recurse on both
+    //halves and join them back. Each returns the number of equal keys found.
+    //levels is the number of fork levels left.
+
+    //this = this | other, the values of this tree win on equal keys
+    std::size_t inner_union(RedBlackTree *other, int levels) {
+        if (other->_root == _sentinel) {
+            return 0;
+        }
+        if (_root == _sentinel) {
+            take_root(other);
+            return 0;
+        }
+
+        Node *m = other->_root;
+        RedBlackTree other_left;
+        RedBlackTree other_right;
+        RedBlackTree right;
+        int height = other->_black_height - 1;
+        other_left.set_root(m->_left, height);
+        other_right.set_root(m->_right, height);
+        other->_root = _sentinel;
+        other->_black_height = 0;
+        Node *found = inner_split(m->_k, &right);
+        std::size_t ret = 0;
+        if (found != _sentinel) {
+            _alloc.destroy(m);
+            m = found;
+            ret++;
+        }
+
+        bool parallel = levels > 0 && other_right._black_height >= kParallelBlackHeight;
+        ret += fork_join(parallel, [&]() {
+            return inner_union(&other_left, levels - 1);
+        }, [&]() {
+            return right.inner_union(&other_right, levels - 1);
+        });
+        inner_join(m, &right);
+        return ret;
+    }
+
+    //this = this & other, the values of this tree are kept
+    std::size_t inner_intersection(RedBlackTree *other, int levels) {
+        if (_root == _sentinel || other->_root == _sentinel) {
+            tree_clear();
+            other->tree_clear();
+            return 0;
         }
 
-        q->_parent = p->_parent;
+        Node *m = other->_root;
+        RedBlackTree other_left;
+        RedBlackTree other_right;
+        RedBlackTree right;
+        int height = other->_black_height - 1;
+        other_left.set_root(m->_left, height);
+        other_right.set_root(m->_right, height);
+        other->_root = _sentinel;
+        other->_black_height = 0;
+        Node *found = inner_split(m->_k, &right);
+        _alloc.destroy(m);
 
-        if (p->_parent == _sentinel) {
-            _root = q;
-        } else if (p == p->_parent->_left) {
-            p->_parent->_left = q;
+        bool parallel = levels > 0 && other_right._black_height >= kParallelBlackHeight;
+        std::size_t ret = fork_join(parallel, [&]() {
+            return inner_intersection(&other_left, levels - 1);
+        }, [&]() {
+            return right.inner_intersection(&other_right, levels - 1);
+        });
+        if (found != _sentinel) {
+            inner_join(found, &right);
+            ret++;
         } else {
-            p->_parent->_right = q;
+            inner_join(&right);
         }
+        return ret;
+    }
 
-        //Copy k/v to node
-        if (p != node) {
-            node->_k = p->_k;
-            node->_v = p->_v;
+    //this = this - other
+    std::size_t inner_difference(RedBlackTree *other, int levels) {
+        if (_root == _sentinel || other->_root == _sentinel) {
+            other->tree_clear();
+            return 0;
         }
 
-        if (p->_c == Color::BLACK) {
-            delete_fixup(q);
+        Node *m = other->_root;
+        RedBlackTree other_left;
+        RedBlackTree other_right;
+        RedBlackTree right;
+        int height = other->_black_height - 1;
+        other_left.set_root(m->_left, height);
+        other_right.set_root(m->_right, height);
+        other->_root = _sentinel;
+        other->_black_height = 0;
+        Node *found = inner_split(m->_k, &right);
+        _alloc.destroy(m);
+
+        bool parallel = levels > 0 && other_right._black_height >= kParallelBlackHeight;
+        std::size_t ret = fork_join(parallel, [&]() {
+            return inner_difference(&other_left, levels - 1);
+        }, [&]() {
+            return right.inner_difference(&other_right, levels - 1);
+        });
+        if (found != _sentinel) {
+            _alloc.destroy(found);
+            ret++;
         }
+        inner_join(&right);
+        return ret;
+    }
 
-        delete p;
-        p = nullptr;
+    uint32_t inner_count(Node *node) const {
+        if (node == _sentinel) {
+            return 0;
+        }
+        return inner_count(node->_left) + inner_count(node->_right) + 1;
+    }
+
+//****************************** Intervals ***********************************
+
+    //In-order walk of the subtree skipping the parts which can not overlap:
+    //subtrees ending before lo and everything starting after hi
+    template <typename T, typename Visitor>
+    std::size_t inner_overlapping(Node *node, const T &lo, const T &hi, Visitor &visitor) {
+        std::size_t count = 0;
+        while (node != _sentinel && !(node->_max < lo)) {
+            count += inner_overlapping(node->_left, lo, hi, visitor);
+            if (hi < node->_k.first) {
+                break;
+            }
+            if (!(node->_k.second < lo)) {
+                visitor(node->_k, node->_v);
+                count++;
+            }
+            node = node->_right;
+        }
+        return count;
     }
 
 //****************************** Cleanup *************************************
 
     //Destroy the tree using pre-order traverse
+    //If the allocator can release all nodes at once, only destruct them here
     void inner_destroy(Node *node) {
         if (node->_left != _sentinel) {
             inner_destroy(node->_left);
@@ -368,7 +952,11 @@ private:
         if (node->_right != _sentinel) {
             inner_destroy(node->_right);
         }
-        delete node;
+        if (Alloc<Node>::kReleaseAll) {
+            node->~Node();
+        } else {
+            _alloc.destroy(node);
+        }
     }
 
 #ifdef UNIT_TEST
@@ -397,7 +985,13 @@ int inner_check_balance(Node *node) {
         }
     }
 
-    int black_height_delta = node->_c == Color::BLACK ? 1 : 0;
+    //A red node must not have a red child
+    if (node->color() == Color::RED &&
+        (node->_left->color() == Color::RED || node->_right->color() == Color::RED)) {
+        return -1;
+    }
+
+    int black_height_delta = node->color() == Color::BLACK ? 1 : 0;
     if (node->_left != _sentinel && node->_right != _sentinel) {
         //Imbalance found
         if (black_height_left != black_height_right) {
@@ -416,43 +1010,169 @@ int inner_check_balance(Node *node) {
 #endif
 
 //****************************** Data area ***********************************
+    //The sentinel is shared by every tree of the same type and never written,
+    //so it needs no allocation and comparing with it needs no memory load
+    static Node _nil;
+    static constexpr Node *_sentinel = &_nil;
+
     Comp _comp = Comp();
-    Node *_sentinel = nullptr;
-    Node *_root = nullptr;
+    Alloc<Node> _alloc;
+    Node *_root = _sentinel;
     uint32_t _size = 0;
+    //Set by tree_split, whose halves are recounted by the next tree_size()
+    bool _size_stale = false;
+    //Black nodes from the root down to the sentinel, kept by the fixups so
+    //joins need no height walk
+    int _black_height = 0;
 
 public:
+//****************************** Iterators ***********************************
+
+    //Bidirectional iterator in key order, it walks by parent pointers so
+    //neither recursion nor allocation is needed.
+    //Dereference gives a pair of references (key, value), operator-> a proxy
+    //holding that pair so it->first and it->second work.
+    //Deletion only invalidates the iterators pointing to the deleted node.
+    template <bool CONST>
+    class basic_iterator {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<CONST, const Value, Value>::type mapped_type;
+        typedef std::pair<const Key&, mapped_type&> reference;
+
+        struct pointer {
+            reference _ref;
+
+            reference * operator->() {
+                return &_ref;
+            }
+        };
+
+        basic_iterator() = default;
+        basic_iterator(const basic_iterator &other) = default;
+        basic_iterator & operator=(const basic_iterator &other) = default;
+
+        //iterator converts to const_iterator, not the other way round
+        template <bool OTHER, typename = typename std::enable_if<CONST && !OTHER>::type>
+        basic_iterator(const basic_iterator<OTHER> &other)
+            : _tree(other._tree), _node(other._node) {}
+
+        const Key & key() const {
+            return _node->_k;
+        }
+
+        mapped_type & value() const {
+            return _node->_v;
+        }
+
+        reference operator*() const {
+            return reference(_node->_k, _node->_v);
+        }
+
+        pointer operator->() const {
+            return pointer{**this};
+        }
+
+        basic_iterator & operator++() {
+            _node = _tree->successor(_node);
+            return *this;
+        }
+
+        basic_iterator operator++(int) {
+            basic_iterator ret = *this;
+            ++(*this);
+            return ret;
+        }
+
+        //Decrementing end() gives the maximum
+        basic_iterator & operator--() {
+            if (_node == _tree->_sentinel) {
+                _node = _tree->maximum(_tree->_root);
+            } else {
+                _node = _tree->predecessor(_node);
+            }
+            return *this;
+        }
+
+        basic_iterator operator--(int) {
+            basic_iterator ret = *this;
+            --(*this);
+            return ret;
+        }
+
+        bool operator==(const basic_iterator &other) const {
+            return _node == other._node;
+        }
+
+        bool operator!=(const basic_iterator &other) const {
+            return _node != other._node;
+        }
+
+    private:
+        friend class RedBlackTree;
+        friend class basic_iterator<!CONST>;
+
+        basic_iterator(const RedBlackTree *tree, Node *node) : _tree(tree), _node(node) {}
+
+        const RedBlackTree *_tree = nullptr;
+        Node *_node = nullptr;
+    };
+
+    typedef basic_iterator<false> iterator;
+    typedef basic_iterator<true> const_iterator;
+
 //****************** Constructors and Deconstructor **************************
 
-    RedBlackTree() {
-        _sentinel = new Node();
-        _root = _sentinel;
-    }
+    RedBlackTree() = default;
 
     virtual ~RedBlackTree() {
         tree_clear();
-        if (_sentinel != nullptr) {
-            delete _sentinel;
-        }
     }
 
 //***************************** Interfaces ***********************************
 
     bool tree_insert(const Key& k, const Value& v) {
-        Node *target = inner_find(k);
-        if (target != _sentinel && target->_k == k) {
+        return try_emplace(k, v);
+    }
+
+    bool tree_insert(Key&& k, Value&& v) {
+        return try_emplace(std::move(k), std::move(v));
+    }
+
+    //Insert a node built from args: the key from the first one and the value
+    //from the rest. The node is built before the lookup, so it is thrown away
+    //if the key exists; prefer try_emplace when the key is at hand.
+    template <typename ...Args>
+    bool emplace(Args&&... args) {
+        Node *node = _alloc.create(std::forward<Args>(args)...);
+        Node *parent = _sentinel;
+        if (inner_find(node->_k, &parent) != _sentinel) {
+            _alloc.destroy(node);
             return false;
         }
 
-        inner_insert(k, v, target);
+        inner_insert(node, parent);
         _size++;
 
         return true;
     }
 
+    //Insert k with a value constructed from args, nothing is constructed,
+    //copied or moved if k exists. A k of another type is converted to Key
+    //once up front unless Comp is transparent and compares it as is.
+    template <typename K, typename ...Args>
+    bool try_emplace(K&& k, Args&&... args) {
+        typedef std::integral_constant<bool,
+            std::is_same<typename std::decay<K>::type, Key>::value ||
+            decltype(is_transparent<Comp>(nullptr))::value> searchable;
+        return try_emplace_key(searchable(), std::forward<K>(k), std::forward<Args>(args)...);
+    }
+
     bool tree_delete(const Key& k) {
         Node *target = inner_find(k);
-        if (target == _sentinel || target->_k != k) {
+        if (target == _sentinel) {
             return false;
         }
 
@@ -463,34 +1183,339 @@ public:
     }
 
     bool tree_find(const Key& k, Value *v) {
-        Node *target = inner_find(k);
-        if (target == _sentinel || target->_k != k) {
+        Value *target = find(k);
+        if (target == nullptr) {
             return false;
         }
 
-        *v = target->_v;
+        *v = *target;
         return true;
     }
 
+    //Return the value of k in place, or nullptr if k does not exist.
+    //The pointer stays valid until k itself is deleted.
+    Value * find(const Key& k) {
+        Node *target = inner_find(k);
+        return target == _sentinel ? nullptr : &target->_v;
+    }
+
+    //Look up every key of keys and store its value pointer into (*out)[i],
+    //or nullptr if keys[i] does not exist.
+    //Up to kBatchWidth lookups walk down in lockstep, each step prefetches the
+    //next node of one lookup and moves on to the others, so the cache misses
+    //of independent lookups overlap instead of stalling one after another.
+    //Worth it once the tree no longer fits in the cache, small trees gain nothing.
+    void find_batch(const std::vector<Key> &keys, std::vector<Value *> *out) {
+        out->resize(keys.size());
+        std::size_t slot_key[kBatchWidth];
+        Node *slot_node[kBatchWidth];
+        std::size_t active = 0;
+        std::size_t next = 0;
+        for (; active < kBatchWidth && next < keys.size(); active++, next++) {
+            slot_key[active] = next;
+            slot_node[active] = _root;
+        }
+
+        while (active > 0) {
+            for (std::size_t i = 0; i < active;) {
+                Node *node = slot_node[i];
+                const Key &k = keys[slot_key[i]];
+                Value *found = nullptr;
+                if (node != _sentinel) {
+                    if (_comp(k, node->_k)) {
+                        node = node->_left;
+                    } else if (_comp(node->_k, k)) {
+                        node = node->_right;
+                    } else {
+                        found = &node->_v;
+                    }
+                    if (found == nullptr) {
+                        __builtin_prefetch(node);
+                        slot_node[i++] = node;
+                        continue;
+                    }
+                }
+
+                //Done, refill the slot with the next key or drop it
+                (*out)[slot_key[i]] = found;
+                if (next < keys.size()) {
+                    slot_key[i] = next++;
+                    slot_node[i] = _root;
+                    i++;
+                } else {
+                    active--;
+                    slot_key[i] = slot_key[active];
+                    slot_node[i] = slot_node[active];
+                }
+            }
+        }
+    }
+
+    //Heterogeneous lookup, e.g. a const char * or std::string_view against
+    //std::string keys without building a temporary key.
+    //Only enabled when Comp defines is_transparent, e.g. std::less<>.
+    template <typename K, typename C = Comp, typename = typename C::is_transparent>
+    Value * find(const K& k) {
+        Node *target = inner_find(k);
+        return target == _sentinel ? nullptr : &target->_v;
+    }
+
     void tree_clear() {
-        if (_root != _sentinel) {
+        //Nothing to destruct, the allocator could drop the whole arena directly
+        bool skip_destroy = Alloc<Node>::kReleaseAll && std::is_trivially_destructible<Node>::value;
+        if (_root != _sentinel && !skip_destroy) {
             inner_destroy(_root);
         }
+        _alloc.release_all();
         _root = _sentinel;
         _size = 0;
+        _size_stale = false;
+        _black_height = 0;
+    }
+
+    //Replace the content with the pairs in [begin, end), which must be sorted
+    //in strictly ascending key order. It builds a balanced tree in O(n)
+    //without any comparison or fixup, e.g. to reload a tree from a snapshot.
+    //Items are read via (*it).first and (*it).second, so iterators of
+    //std::map, a vector of pairs or another RedBlackTree all work.
+    //Returns false and keeps the tree untouched if the input is not sorted.
+    template <typename Iterator>
+    bool bulk_load(Iterator begin, Iterator end) {
+        std::size_t n = 0;
+        for (Iterator prev = begin, it = begin; it != end; prev = it, ++it, ++n) {
+            if (n > 0 && !_comp((*prev).first, (*it).first)) {
+                return false;
+            }
+        }
+
+        tree_clear();
+        if (n == 0) {
+            return true;
+        }
+
+        int red_depth = -1;
+        if (n > 1) {
+            red_depth = 0;
+            while ((n >> (red_depth + 1)) != 0) {
+                red_depth++;
+            }
+        }
+
+        _alloc.reserve(n);
+        _root = inner_build(begin, n, 0, red_depth);
+        _size = n;
+        _size_stale = false;
+        _black_height = black_height(_root);
+        return true;
+    }
+
+    //The i-th smallest key (0 based), end() if i is out of range
+    //Only available with RedBlackTreeOrderStatistic, O(log n)
+    iterator select(std::size_t i) {
+        static_assert(std::is_same<Augment, RedBlackTreeOrderStatistic>::value,
+                      "select() needs RedBlackTreeOrderStatistic");
+        Node *temp = _root;
+        while (temp != _sentinel) {
+            std::size_t left_count = temp->_left->_count;
+            if (i < left_count) {
+                temp = temp->_left;
+            } else if (i == left_count) {
+                break;
+            } else {
+                i -= left_count + 1;
+                temp = temp->_right;
+            }
+        }
+        return iterator(this, temp);
     }
 
+    //The number of keys less than k, which is also the position of k if it exists
+    //Only available with RedBlackTreeOrderStatistic, O(log n)
+    std::size_t rank(const Key &k) {
+        static_assert(std::is_same<Augment, RedBlackTreeOrderStatistic>::value,
+                      "rank() needs RedBlackTreeOrderStatistic");
+        std::size_t ret = 0;
+        Node *temp = _root;
+        while (temp != _sentinel) {
+            if (_comp(temp->_k, k)) {
+                ret += temp->_left->_count + 1;
+                temp = temp->_right;
+            } else {
+                temp = temp->_left;
+            }
+        }
+        return ret;
+    }
+
+    //Move every key of right into this tree, right is left empty.
+    //All keys of right must be greater than those of this tree, otherwise
+    //nothing changes and false is returned. O(log n).
+    bool tree_join(RedBlackTree *right) {
+        static_assert(Alloc<Node>::kTransferable, "tree_join() needs a transferable allocator");
+        if (right == this || right->_root == _sentinel) {
+            return true;
+        }
+        if (_root != _sentinel && !_comp(maximum(_root)->_k, minimum(right->_root)->_k)) {
+            return false;
+        }
+
+        _size += right->_size;
+        _size_stale = _size_stale || right->_size_stale;
+        inner_join(right);
+        right->_size = 0;
+        right->_size_stale = false;
+        return true;
+    }
+
+    //Move the keys not less than k into right, the former content of right
+    //is dropped. O(log n), but subtrees do not track their sizes, so both
+    //trees are recounted in O(n) by their next tree_size().
+    void tree_split(const Key &k, RedBlackTree *right) {
+        static_assert(Alloc<Node>::kTransferable, "tree_split() needs a transferable allocator");
+        if (right == this) {
+            return;
+        }
+        right->tree_clear();
+        Node *found = inner_split(k, right);
+        if (found != _sentinel) {
+            found->set_color(Color::RED);
+            right->inner_insert(found, right->_root == _sentinel ? _sentinel : minimum(right->_root));
+        }
+        _size_stale = true;
+        right->_size_stale = true;
+    }
+
+    //Set operations, the result is left in this tree and other is emptied.
+    //Nodes are moved instead of copied; the split/join recursion costs
+    //O(m log(n / m + 1)) for sizes m <= n, plus freeing the dropped nodes,
+    //and its halves run on separate threads while the subtrees are large.
+    //Sizes left stale by tree_split stay stale instead of being recounted.
+
+    //Add the keys of other, on equal keys the value of this tree is kept
+    void tree_union(RedBlackTree *other) {
+        static_assert(Alloc<Node>::kTransferable, "tree_union() needs a transferable allocator");
+        if (other == this) {
+            return;
+        }
+        _size_stale = _size_stale || other->_size_stale;
+        _size = _size + other->_size - inner_union(other, parallel_levels());
+        other->tree_clear();
+    }
+
+    //Keep only the keys which also exist in other
+    void tree_intersection(RedBlackTree *other) {
+        static_assert(Alloc<Node>::kTransferable,
+                      "tree_intersection() needs a transferable allocator");
+        if (other == this) {
+            return;
+        }
+        _size_stale = false;
+        _size = inner_intersection(other, parallel_levels());
+        other->tree_clear();
+    }
+
+    //Remove the keys which exist in other
+    void tree_difference(RedBlackTree *other) {
+        static_assert(Alloc<Node>::kTransferable, "tree_difference() needs a transferable allocator");
+        if (other == this) {
+            tree_clear();
+            return;
+        }
+        _size -= inner_difference(other, parallel_levels());
+        other->tree_clear();
+    }
+
+    //Visit every interval overlapping the closed interval [lo, hi] in key order
+    //with visitor(const Key&, Value&), e.g. lo == hi == t finds the intervals
+    //covering t. Returns the number of intervals visited.
+    //Only available with RedBlackTreeIntervalAugment. Subtrees which can not
+    //overlap are skipped by their max endpoint, so it costs O(log n) plus at
+    //most O(log n) per result, usually much less, and allocates nothing.
+    template <typename T, typename Visitor>
+    std::size_t overlapping(const T &lo, const T &hi, Visitor visitor) {
+        static_assert(std::is_same<Augment, RedBlackTreeIntervalAugment>::value,
+                      "overlapping() needs RedBlackTreeIntervalAugment");
+        return inner_overlapping(_root, lo, hi, visitor);
+    }
+
+    //O(1), except for the first call after tree_split, which recounts in O(n)
     uint32_t tree_size() {
+        if (_size_stale) {
+            _size = inner_count(_root);
+            _size_stale = false;
+        }
         return _size;
     }
 
+    iterator begin() {
+        return iterator(this, _root == _sentinel ? _sentinel : minimum(_root));
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, _root == _sentinel ? _sentinel : minimum(_root));
+    }
+
+    iterator end() {
+        return iterator(this, _sentinel);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, _sentinel);
+    }
+
+    iterator lower_bound(const Key &k) {
+        return iterator(this, inner_lower_bound(k));
+    }
+
+    const_iterator lower_bound(const Key &k) const {
+        return const_iterator(this, inner_lower_bound(k));
+    }
+
+    iterator upper_bound(const Key &k) {
+        return iterator(this, inner_upper_bound(k));
+    }
+
+    const_iterator upper_bound(const Key &k) const {
+        return const_iterator(this, inner_upper_bound(k));
+    }
+
+    //Visit every key in [lo, hi) in order with visitor(const Key&, Value&)
+    //It costs O(log n + k) and returns k, the number of keys visited
+    template <typename Visitor>
+    std::size_t range(const Key &lo, const Key &hi, Visitor visitor) {
+        std::size_t count = 0;
+        Node *node = inner_lower_bound(lo);
+        while (node != _sentinel && _comp(node->_k, hi)) {
+            visitor(node->_k, node->_v);
+            node = successor(node);
+            count++;
+        }
+        return count;
+    }
+
 #ifdef UNIT_TEST
     bool check_balanced() {
-        return inner_check_balance(_root) < 0 ? false : true;
+        //The shared sentinel must never be written
+        if (_nil.color() != Color::BLACK || _nil.parent() != nullptr ||
+            _nil._left != nullptr || _nil._right != nullptr) {
+            return false;
+        }
+        //Joins rely on the kept black height
+        return inner_check_balance(_root) == _black_height;
     }
 #endif
 };
 
+template <typename Key, typename Value, typename Comp,
+          template <typename> class Alloc, typename Augment>
+typename RedBlackTree<Key, Value, Comp, Alloc, Augment>::Node
+RedBlackTree<Key, Value, Comp, Alloc, Augment>::_nil;
+
+template <typename Key, typename Value, typename Comp,
+          template <typename> class Alloc, typename Augment>
+constexpr typename RedBlackTree<Key, Value, Comp, Alloc, Augment>::Node *
+RedBlackTree<Key, Value, Comp, Alloc, Augment>::_sentinel;
+
 END_NAMESPACE_SIMPLELIB
 
 #endif  //SIMPLELIB_RED_BLACK_TREE_HPP_
@@ -0,0 +1,372 @@
+#include <map>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <malloc.h>
+#include "red_black_tree.hpp"
+#include "compact_red_black_tree.hpp"
+#include "frozen_red_black_tree.hpp"
+
+using namespace simplelib;
+
+//Run func once and return the elapsed wall time in milliseconds
+template <typename Func>
+double time_ms(Func func) {
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+//Bytes currently allocated from the heap (glibc only)
+size_t heap_in_use() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+//Fill the tree, then repeatedly erase and re-insert half of the keys, then clear
+template <typename Tree>
+void bench_churn(const char *name, const std::vector<int> &keys, int rounds) {
+    Tree tree;
+    std::vector<int> victims(keys.begin(), keys.begin() + keys.size() / 2);
+
+    double fill = time_ms([&]() {
+        for (int k : keys) {
+            tree.tree_insert(k, k);
+        }
+    });
+
+    double churn = time_ms([&]() {
+        for (int r = 0; r < rounds; r++) {
+            for (int k : victims) {
+                tree.tree_delete(k);
+            }
+            for (int k : victims) {
+                tree.tree_insert(k, k);
+            }
+        }
+    });
+
+    double clear = time_ms([&]() {
+        tree.tree_clear();
+    });
+
+    printf("%-16s fill %9.2f ms  churn %9.2f ms  clear %9.2f ms\n", name, fill, churn, clear);
+}
+
+//Warm up a tree from sorted keys: one insert per key vs bulk_load
+template <typename Tree>
+void bench_warmup(const char *name, const std::vector<std::pair<int, int>> &sorted) {
+    Tree by_insert;
+    Tree by_load;
+
+    double insert = time_ms([&]() {
+        for (auto &kv : sorted) {
+            by_insert.tree_insert(kv.first, kv.second);
+        }
+    });
+
+    double load = time_ms([&]() {
+        by_load.bulk_load(sorted.begin(), sorted.end());
+    });
+
+    double reload = time_ms([&]() {
+        by_insert.bulk_load(by_load.begin(), by_load.end());
+    });
+
+    printf("%-16s insert %9.2f ms  bulk_load %9.2f ms  reload from tree %9.2f ms\n",
+           name, insert, load, reload);
+}
+
+//Insert/find/delete throughput plus heap bytes per key since heap_before
+template <typename Tree>
+void bench_layout(const char *name, const std::vector<int> &keys, Tree *tree, size_t heap_before) {
+    double insert = time_ms([&]() {
+        for (int k : keys) {
+            tree->tree_insert(k, k);
+        }
+    });
+
+    double bytes_per_key = static_cast<double>(heap_in_use() - heap_before) / keys.size();
+
+    long sum = 0;
+    double find = time_ms([&]() {
+        int v = 0;
+        for (int k : keys) {
+            if (tree->tree_find(k, &v)) {
+                sum += v;
+            }
+        }
+    });
+
+    double erase = time_ms([&]() {
+        for (int k : keys) {
+            tree->tree_delete(k);
+        }
+    });
+
+    double mops = keys.size() / 1000.0;
+    printf("%-16s %6.1f B/key  insert %6.2f Mops/s  find %6.2f Mops/s  delete %6.2f Mops/s%s\n",
+           name, bytes_per_key, mops / insert, mops / find, mops / erase, sum == 0 ? " !" : "");
+}
+
+//Random lookups one by one vs find_batch over batches of batch_size keys
+template <typename Tree>
+void bench_batch(const char *name, const std::vector<int> &keys, size_t batch_size) {
+    Tree tree;
+    for (int k : keys) {
+        tree.tree_insert(k, k);
+    }
+
+    long sum = 0;
+    double single = time_ms([&]() {
+        for (int k : keys) {
+            int *v = tree.find(k);
+            if (v != nullptr) {
+                sum += *v;
+            }
+        }
+    });
+
+    std::vector<int> batch;
+    std::vector<int *> out;
+    double batched = time_ms([&]() {
+        for (size_t i = 0; i < keys.size(); i += batch_size) {
+            batch.assign(keys.begin() + i, keys.begin() + std::min(keys.size(), i + batch_size));
+            tree.find_batch(batch, &out);
+            for (int *v : out) {
+                if (v != nullptr) {
+                    sum += *v;
+                }
+            }
+        }
+    });
+
+    double mops = keys.size() / 1000.0;
+    printf("%-16s find %6.2f Mops/s  find_batch %6.2f Mops/s  speedup %5.2fx%s\n",
+           name, mops / single, mops / batched, single / batched, sum == 0 ? " !" : "");
+}
+
+//Merge two trees of n random keys each: re-insert one by one vs tree_union,
+//plus tree_intersection and tree_difference of the same inputs
+void bench_set_ops(size_t n) {
+    typedef RedBlackTree<int, int> Tree;
+    std::default_random_engine engine(2021);
+    std::uniform_int_distribution<int> key_dist(0, static_cast<int>(n * 4));
+    std::vector<int> a_keys(n);
+    std::vector<int> b_keys(n);
+    for (size_t i = 0; i < n; i++) {
+        a_keys[i] = key_dist(engine);
+        b_keys[i] = key_dist(engine);
+    }
+    auto build = [](const std::vector<int> &keys, Tree *tree) {
+        for (int k : keys) {
+            tree->tree_insert(k, k);
+        }
+    };
+
+    Tree a;
+    Tree b;
+    build(a_keys, &a);
+    build(b_keys, &b);
+    double reinsert = time_ms([&]() {
+        for (auto it = b.begin(); it != b.end(); ++it) {
+            a.tree_insert((*it).first, (*it).second);
+        }
+        b.tree_clear();
+    });
+    uint32_t expected = a.tree_size();
+
+    double timings[3];
+    for (int op = 0; op < 3; op++) {
+        Tree x;
+        Tree y;
+        build(a_keys, &x);
+        build(b_keys, &y);
+        timings[op] = time_ms([&]() {
+            if (op == 0) {
+                x.tree_union(&y);
+            } else if (op == 1) {
+                x.tree_intersection(&y);
+            } else {
+                x.tree_difference(&y);
+            }
+        });
+        if (op == 0 && x.tree_size() != expected) {
+            printf("union size mismatch !\n");
+        }
+    }
+
+    printf("re-insert %9.2f ms  union %9.2f ms  intersection %9.2f ms  difference %9.2f ms\n",
+           reinsert, timings[0], timings[1], timings[2]);
+}
+
+//Random lookups on a tree vs its frozen copy, plus the cost of freeze/thaw
+void bench_frozen(const std::vector<int> &keys) {
+    RedBlackTree<int, int> tree;
+    for (int k : keys) {
+        tree.tree_insert(k, k);
+    }
+
+    FrozenRedBlackTree<int, int> frozen;
+    double freeze = time_ms([&]() {
+        frozen.freeze(tree);
+    });
+
+    long sum = 0;
+    double tree_find = time_ms([&]() {
+        int v = 0;
+        for (int k : keys) {
+            if (tree.tree_find(k, &v)) {
+                sum += v;
+            }
+        }
+    });
+
+    double frozen_find = time_ms([&]() {
+        int v = 0;
+        for (int k : keys) {
+            if (frozen.tree_find(k, &v)) {
+                sum += v;
+            }
+        }
+    });
+
+    double thaw = time_ms([&]() {
+        frozen.thaw(&tree);
+    });
+
+    double mops = keys.size() / 1000.0;
+    printf("tree find %6.2f Mops/s  frozen find %6.2f Mops/s  freeze %8.2f ms  thaw %8.2f ms%s\n",
+           mops / tree_find, mops / frozen_find, freeze, thaw, sum == 0 ? " !" : "");
+}
+
+//Startup: rebuild a tree by insertion vs map a saved image and query it
+void bench_image(const std::vector<int> &keys, const char *path) {
+    RedBlackTree<int, int> tree;
+    double rebuild = time_ms([&]() {
+        for (int k : keys) {
+            tree.tree_insert(k, k);
+        }
+    });
+
+    double save = time_ms([&]() {
+        FrozenRedBlackTree<int, int> frozen;
+        frozen.freeze(tree);
+        frozen.save(path);
+    });
+
+    FrozenRedBlackTree<int, int> mapped;
+    double map = time_ms([&]() {
+        mapped.map(path);
+    });
+
+    long sum = 0;
+    size_t probes = std::min<size_t>(keys.size(), 100000);
+    double first = time_ms([&]() {
+        int v = 0;
+        for (size_t i = 0; i < probes; i++) {
+            if (mapped.tree_find(keys[i], &v)) {
+                sum += v;
+            }
+        }
+    });
+
+    printf("rebuild %9.2f ms  save %9.2f ms  map %6.3f ms  first %zu finds %8.2f ms%s\n",
+           rebuild, save, map, probes, first, sum == 0 ? " !" : "");
+    remove(path);
+}
+
+//std::map adapted to the tree interface
+class StdMap : public std::map<int, int> {
+public:
+    bool tree_insert(int k, int v) {
+        return emplace(k, v).second;
+    }
+
+    bool tree_find(int k, int *v) {
+        auto it = find(k);
+        if (it == end()) {
+            return false;
+        }
+        *v = it->second;
+        return true;
+    }
+
+    bool tree_delete(int k) {
+        return erase(k) == 1;
+    }
+};
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    int rounds = 5;
+
+    std::vector<int> keys(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = static_cast<int>(i);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::default_random_engine(2021));
+
+    printf("== Node allocation: %zu keys, %d churn rounds ==\n", n, rounds);
+    bench_churn<RedBlackTree<int, int>>("global new", keys, rounds);
+    bench_churn<RedBlackTree<int, int, std::less<int>, PoolNodeAllocator>>("node pool", keys, rounds);
+
+    std::vector<std::pair<int, int>> sorted(n);
+    for (size_t i = 0; i < n; i++) {
+        sorted[i] = std::make_pair(static_cast<int>(i), static_cast<int>(i));
+    }
+
+    printf("== Warm up from sorted input: %zu keys ==\n", n);
+    bench_warmup<RedBlackTree<int, int>>("global new", sorted);
+    bench_warmup<RedBlackTree<int, int, std::less<int>, PoolNodeAllocator>>("node pool", sorted);
+
+    size_t layout_n = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10000000;
+    std::vector<int> layout_keys(layout_n);
+    for (size_t i = 0; i < layout_n; i++) {
+        layout_keys[i] = static_cast<int>(i);
+    }
+    std::shuffle(layout_keys.begin(), layout_keys.end(), std::default_random_engine(2021));
+
+    printf("== Node layout: %zu random keys ==\n", layout_n);
+    {
+        size_t heap_before = heap_in_use();
+        StdMap tree;
+        bench_layout("std::map", layout_keys, &tree, heap_before);
+    }
+    {
+        size_t heap_before = heap_in_use();
+        RedBlackTree<int, int> tree;
+        bench_layout("global new", layout_keys, &tree, heap_before);
+    }
+    {
+        size_t heap_before = heap_in_use();
+        RedBlackTree<int, int, std::less<int>, PoolNodeAllocator> tree;
+        bench_layout("node pool", layout_keys, &tree, heap_before);
+    }
+    {
+        size_t heap_before = heap_in_use();
+        CompactRedBlackTree<int, int> tree;
+        tree.reserve(layout_n);
+        bench_layout("compact 32-bit", layout_keys, &tree, heap_before);
+    }
+
+    printf("== Batch lookup: %zu random keys, batches of 1024 ==\n", layout_n);
+    bench_batch<RedBlackTree<int, int>>("global new", layout_keys, 1024);
+    bench_batch<RedBlackTree<int, int, std::less<int>, PoolNodeAllocator>>("node pool", layout_keys, 1024);
+
+    printf("== Frozen layout: %zu random keys ==\n", layout_n);
+    bench_frozen(layout_keys);
+
+    printf("== Startup from an image: %zu random keys ==\n", layout_n);
+    bench_image(layout_keys, "red_black_tree_bench.img");
+
+    printf("== Set operations: two trees of %zu random keys, %u hardware threads ==\n",
+           n, std::thread::hardware_concurrency());
+    bench_set_ops(n);
+
+    return 0;
+}
@@ -1,9 +1,21 @@
 #include <random>
 #include <chrono>
 #include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
 #include <algorithm>
+#include <cstdio>
+#include <unistd.h>
 #include "gtest/gtest.h"
 #include "red_black_tree.hpp"
+#include "compact_red_black_tree.hpp"
+#include "persistent_red_black_tree.hpp"
+#include "concurrent_red_black_tree.hpp"
+#include "frozen_red_black_tree.hpp"
 
 using namespace simplelib;
 
@@ -68,6 +80,985 @@ TEST_F(RedBlackTreeTest, Test_ALL) {
     }
 }
 
+TEST(RedBlackTreePoolTest, Test_Churn) {
+    RedBlackTree<int, std::string, std::less<int>, PoolNodeAllocator> rbt;
+    std::vector<int> v;
+    for (int i = 0; i < 1000; i++) {
+      v.push_back(i);
+    }
+
+    std::default_random_engine engine(2021);
+    for (int round = 0; round < 10; round++) {
+        std::shuffle(v.begin(), v.end(), engine);
+        for (size_t i = 0; i < v.size(); i++) {
+            ASSERT_TRUE(rbt.tree_insert(v[i], std::to_string(v[i])));
+        }
+        ASSERT_TRUE(rbt.check_balanced());
+        ASSERT_EQ(rbt.tree_size(), v.size());
+
+        //Freed nodes are reused by the following insertions
+        std::shuffle(v.begin(), v.end(), engine);
+        for (size_t i = 0; i < v.size() / 2; i++) {
+            ASSERT_TRUE(rbt.tree_delete(v[i]));
+        }
+        for (size_t i = 0; i < v.size() / 2; i++) {
+            ASSERT_TRUE(rbt.tree_insert(v[i], std::to_string(v[i])));
+        }
+        ASSERT_TRUE(rbt.check_balanced());
+        for (size_t i = 0; i < v.size(); i++) {
+            std::string temp;
+            ASSERT_TRUE(rbt.tree_find(v[i], &temp));
+            ASSERT_EQ(std::to_string(v[i]), temp);
+        }
+
+        //Non-trivial values are destructed before the arena goes away
+        rbt.tree_clear();
+        ASSERT_EQ(rbt.tree_size(), 0);
+    }
+}
+
+TEST(RedBlackTreePoolTest, Test_Reserve) {
+    PoolNodeAllocator<int64_t> pool;
+    std::vector<int64_t *> nodes;
+    for (int i = 0; i < 10; i++) {
+        nodes.push_back(pool.create(i));
+    }
+
+    //The rest of the first slab is used before the reserved one, in order
+    pool.reserve(100);
+    for (int i = 10; i < 110; i++) {
+        nodes.push_back(pool.create(i));
+    }
+    for (int i = 1; i < 64; i++) {
+        ASSERT_EQ(nodes[i - 1] + 1, nodes[i]);
+    }
+    for (int i = 65; i < 110; i++) {
+        ASSERT_EQ(nodes[i - 1] + 1, nodes[i]);
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        ASSERT_EQ(static_cast<int64_t>(i), *nodes[i]);
+        pool.destroy(nodes[i]);
+    }
+}
+
+TEST_F(RedBlackTreeTest, Test_Iterator) {
+    ASSERT_TRUE(_rbt->begin() == _rbt->end());
+
+    std::vector<int> v;
+    for (int i = 0; i < 1000; i++) {
+      v.push_back(i * 2);
+    }
+    std::shuffle(v.begin(), v.end(), std::default_random_engine(2021));
+    for (size_t i = 0; i < v.size(); i++) {
+        ASSERT_TRUE(_rbt->tree_insert(v[i], v[i] + 1));
+    }
+
+    //Forward
+    int expected = 0;
+    for (auto kv : *_rbt) {
+        ASSERT_EQ(expected, kv.first);
+        ASSERT_EQ(expected + 1, kv.second);
+        expected += 2;
+    }
+    ASSERT_EQ(2000, expected);
+
+    //Backward from end()
+    auto it = _rbt->end();
+    for (int i = 999; i >= 0; i--) {
+        --it;
+        ASSERT_EQ(i * 2, it.key());
+    }
+    ASSERT_TRUE(it == _rbt->begin());
+
+    //Values are writable through iterator
+    _rbt->begin().value() = -1;
+    int temp = 0;
+    ASSERT_TRUE(_rbt->tree_find(0, &temp));
+    ASSERT_EQ(-1, temp);
+    _rbt->begin()->second = -2;
+    ASSERT_EQ(-2, _rbt->begin()->second);
+    ASSERT_EQ(0, _rbt->begin()->first);
+
+    //iterator converts to const_iterator, assignable both ways of the same kind
+    RedBlackTree<int, int>::const_iterator cit = _rbt->begin();
+    cit = _rbt->lower_bound(4);
+    ASSERT_EQ(4, cit->first);
+    ASSERT_FALSE((std::is_convertible<RedBlackTree<int, int>::const_iterator,
+                                      RedBlackTree<int, int>::iterator>::value));
+    ASSERT_EQ(2, std::distance(_rbt->begin(), _rbt->lower_bound(4)));
+
+    //Bounds
+    ASSERT_EQ(10, _rbt->lower_bound(10).key());
+    ASSERT_EQ(12, _rbt->lower_bound(11).key());
+    ASSERT_EQ(12, _rbt->upper_bound(10).key());
+    ASSERT_EQ(0, _rbt->lower_bound(-5).key());
+    ASSERT_TRUE(_rbt->lower_bound(1999) == _rbt->end());
+    ASSERT_TRUE(_rbt->upper_bound(1998) == _rbt->end());
+
+    //Range [lo, hi)
+    std::vector<int> keys;
+    auto visitor = [&keys](const int &k, int &v) { keys.push_back(k); };
+    ASSERT_EQ(5, _rbt->range(100, 110, visitor));
+    ASSERT_EQ(std::vector<int>({100, 102, 104, 106, 108}), keys);
+    keys.clear();
+    ASSERT_EQ(0, _rbt->range(101, 102, visitor));
+    ASSERT_EQ(1000, _rbt->range(-1, 5000, visitor));
+    ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+}
+
+TEST_F(RedBlackTreeTest, Test_BulkLoad) {
+    for (int n = 0; n < 300; n++) {
+        std::vector<std::pair<int, int>> sorted;
+        for (int i = 0; i < n; i++) {
+            sorted.push_back(std::make_pair(i * 3, i));
+        }
+        ASSERT_TRUE(_rbt->bulk_load(sorted.begin(), sorted.end()));
+        ASSERT_TRUE(_rbt->check_balanced());
+        ASSERT_EQ(_rbt->tree_size(), n);
+        int i = 0;
+        for (auto kv : *_rbt) {
+            ASSERT_EQ(i * 3, kv.first);
+            ASSERT_EQ(i, kv.second);
+            i++;
+        }
+        ASSERT_EQ(n, i);
+
+        //The loaded tree keeps working as a normal one
+        for (int i = 0; i < n; i++) {
+            ASSERT_TRUE(_rbt->tree_insert(i * 3 + 1, i));
+            ASSERT_TRUE(_rbt->tree_delete(i * 3));
+        }
+        ASSERT_TRUE(_rbt->check_balanced());
+        ASSERT_EQ(_rbt->tree_size(), n);
+    }
+
+    //Unsorted or duplicated input is rejected and the tree is untouched
+    std::vector<std::pair<int, int>> unsorted = {{1, 1}, {3, 3}, {2, 2}};
+    std::vector<std::pair<int, int>> duplicated = {{1, 1}, {1, 1}};
+    ASSERT_FALSE(_rbt->bulk_load(unsorted.begin(), unsorted.end()));
+    ASSERT_FALSE(_rbt->bulk_load(duplicated.begin(), duplicated.end()));
+    ASSERT_EQ(_rbt->tree_size(), 299);
+
+    //Rebuild from another tree or a std::map
+    RedBlackTree<int, int, std::less<int>, PoolNodeAllocator> copy;
+    ASSERT_TRUE(copy.bulk_load(_rbt->begin(), _rbt->end()));
+    ASSERT_TRUE(copy.check_balanced());
+    ASSERT_TRUE(std::equal(copy.begin(), copy.end(), _rbt->begin()));
+    std::map<int, int> m = {{5, 50}, {6, 60}, {7, 70}};
+    ASSERT_TRUE(copy.bulk_load(m.begin(), m.end()));
+    ASSERT_EQ(copy.tree_size(), 3);
+    int temp = 0;
+    ASSERT_TRUE(copy.tree_find(6, &temp));
+    ASSERT_EQ(60, temp);
+}
+
+TEST(RedBlackTreeOrderStatisticTest, Test_Select_Rank) {
+    RedBlackTree<int, int, std::less<int>, NewNodeAllocator, RedBlackTreeOrderStatistic> rbt;
+    std::vector<int> v;
+    for (int i = 0; i < 500; i++) {
+      v.push_back(i * 2);
+    }
+
+    std::default_random_engine engine(2021);
+    std::shuffle(v.begin(), v.end(), engine);
+    for (size_t i = 0; i < v.size(); i++) {
+        ASSERT_TRUE(rbt.tree_insert(v[i], v[i]));
+    }
+
+    //Delete a random half, subtree sizes must follow rotations of both fixups
+    std::vector<int> alive(v.begin() + v.size() / 2, v.end());
+    for (size_t i = 0; i < v.size() / 2; i++) {
+        ASSERT_TRUE(rbt.tree_delete(v[i]));
+    }
+    ASSERT_TRUE(rbt.check_balanced());
+    std::sort(alive.begin(), alive.end());
+    for (size_t i = 0; i < alive.size(); i++) {
+        ASSERT_EQ(alive[i], rbt.select(i).key());
+        ASSERT_EQ(i, rbt.rank(alive[i]));
+        //rank of an absent key is its insertion position
+        ASSERT_EQ(i + 1, rbt.rank(alive[i] + 1));
+    }
+    ASSERT_TRUE(rbt.select(alive.size()) == rbt.end());
+    ASSERT_EQ(0, rbt.rank(-1));
+
+    //Bulk loaded trees carry subtree sizes as well
+    std::vector<std::pair<int, int>> sorted;
+    for (int i = 0; i < 777; i++) {
+        sorted.push_back(std::make_pair(i, i));
+    }
+    ASSERT_TRUE(rbt.bulk_load(sorted.begin(), sorted.end()));
+    for (int i = 0; i < 777; i++) {
+        ASSERT_EQ(i, rbt.select(i).key());
+        ASSERT_EQ(i, rbt.rank(i));
+    }
+}
+
+TEST(RedBlackTreeMoveTest, Test_Emplace_Find) {
+    //Move-only values go in without any copy
+    RedBlackTree<std::string, std::unique_ptr<int>> rbt;
+    std::string key = "one";
+    ASSERT_TRUE(rbt.tree_insert(std::move(key), std::unique_ptr<int>(new int(1))));
+    ASSERT_TRUE(rbt.try_emplace(std::string("two"), new int(2)));
+    ASSERT_TRUE(rbt.emplace("three", new int(3)));
+    ASSERT_FALSE(rbt.try_emplace(std::string("two"), std::unique_ptr<int>(new int(22))));
+    ASSERT_FALSE(rbt.emplace("three"));
+    ASSERT_EQ(3, rbt.tree_size());
+
+    std::unique_ptr<int> *two = rbt.find("two");
+    ASSERT_NE(nullptr, two);
+    ASSERT_EQ(2, **two);
+    ASSERT_EQ(nullptr, rbt.find("four"));
+    **rbt.find("one") = 11;
+    ASSERT_EQ(11, **rbt.find("one"));
+
+    //Heterogeneous lookup with a transparent comparator
+    RedBlackTree<std::string, int, std::less<>> transparent;
+    ASSERT_TRUE(transparent.tree_insert("abc", 1));
+    const char *probe = "abc";
+    ASSERT_NE(nullptr, transparent.find(probe));
+    ASSERT_EQ(1, *transparent.find(probe));
+    ASSERT_EQ(nullptr, transparent.find("abd"));
+
+    //Arguments are left alone when the key exists
+    std::unique_ptr<int> spare(new int(5));
+    ASSERT_FALSE(rbt.try_emplace(std::string("one"), std::move(spare)));
+    ASSERT_NE(nullptr, spare);
+}
+
+//Key built from const char *, counting conversions
+struct ConvertedKey {
+    static int conversions;
+
+    ConvertedKey() = default;
+
+    ConvertedKey(const char *s) : _s(s) {
+        conversions++;
+    }
+
+    bool operator<(const ConvertedKey &other) const {
+        return _s < other._s;
+    }
+
+    std::string _s;
+};
+
+int ConvertedKey::conversions = 0;
+
+TEST(RedBlackTreeMoveTest, Test_Convert_Once) {
+    RedBlackTree<ConvertedKey, int> rbt;
+    const char *keys[] = {"d", "b", "f", "a", "c", "e", "g"};
+    for (const char *k : keys) {
+        ASSERT_TRUE(rbt.try_emplace(k, 0));
+    }
+    ConvertedKey::conversions = 0;
+    ASSERT_TRUE(rbt.try_emplace("h", 1));
+    ASSERT_EQ(1, ConvertedKey::conversions);
+    ASSERT_FALSE(rbt.try_emplace("c", 1));
+    ASSERT_EQ(2, ConvertedKey::conversions);
+    ASSERT_EQ(8, rbt.tree_size());
+}
+
+TEST_F(RedBlackTreeTest, Test_Reference_Stability) {
+    std::vector<int> v;
+    for (int i = 0; i < 1000; i++) {
+      v.push_back(i);
+    }
+    std::default_random_engine engine(2021);
+    std::shuffle(v.begin(), v.end(), engine);
+    for (size_t i = 0; i < v.size(); i++) {
+        ASSERT_TRUE(_rbt->tree_insert(v[i], v[i]));
+    }
+
+    //Deleting nodes with two children must not move the payload of others
+    std::vector<int *> refs(v.size());
+    for (int i = 0; i < 1000; i++) {
+        refs[i] = _rbt->find(i);
+    }
+    std::shuffle(v.begin(), v.end(), engine);
+    std::vector<bool> deleted(v.size(), false);
+    for (size_t i = 0; i < v.size() / 2; i++) {
+        ASSERT_TRUE(_rbt->tree_delete(v[i]));
+        deleted[v[i]] = true;
+    }
+    ASSERT_TRUE(_rbt->check_balanced());
+    for (int i = 0; i < 1000; i++) {
+        if (!deleted[i]) {
+            ASSERT_EQ(refs[i], _rbt->find(i));
+            ASSERT_EQ(i, *refs[i]);
+        }
+    }
+}
+
+TEST_F(RedBlackTreeTest, Test_FindBatch) {
+    std::vector<int *> out;
+    std::vector<int> keys;
+    _rbt->find_batch(keys, &out);
+    ASSERT_TRUE(out.empty());
+
+    for (int i = 0; i < 1000; i += 2) {
+        ASSERT_TRUE(_rbt->tree_insert(i, i * 3));
+    }
+
+    //Hits, misses and duplicates, more keys than the lookups in flight
+    for (int i = -10; i < 1010; i++) {
+        keys.push_back(i);
+        keys.push_back(1000 - i);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::default_random_engine(2021));
+    _rbt->find_batch(keys, &out);
+    ASSERT_EQ(keys.size(), out.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        ASSERT_EQ(_rbt->find(keys[i]), out[i]);
+        if (out[i] != nullptr) {
+            ASSERT_EQ(keys[i] * 3, *out[i]);
+        }
+    }
+
+    //A batch smaller than the lookups in flight
+    keys.assign({4, 5, 6});
+    _rbt->find_batch(keys, &out);
+    ASSERT_EQ(3, out.size());
+    ASSERT_EQ(12, *out[0]);
+    ASSERT_EQ(nullptr, out[1]);
+    ASSERT_EQ(18, *out[2]);
+}
+
+TEST(RedBlackTreeIntervalTest, Test_Overlapping) {
+    typedef std::pair<int, int> Interval;
+    typedef RedBlackTree<Interval, int, std::less<Interval>, NewNodeAllocator,
+                         RedBlackTreeIntervalAugment> Tree;
+    Tree rbt;
+    std::set<Interval> oracle;
+    std::default_random_engine engine(2021);
+    std::uniform_int_distribution<int> point_dist(0, 10000);
+    std::uniform_int_distribution<int> length_dist(0, 300);
+
+    //Check a query against a linear scan of the oracle
+    auto check_query = [&rbt, &oracle](int lo, int hi) {
+        std::vector<Interval> expected;
+        for (const Interval &i : oracle) {
+            if (i.first <= hi && lo <= i.second) {
+                expected.push_back(i);
+            }
+        }
+        std::vector<Interval> found;
+        size_t n = rbt.overlapping(lo, hi, [&found](const Interval &k, int &v) {
+            ASSERT_EQ(k.second - k.first, v);
+            found.push_back(k);
+        });
+        ASSERT_EQ(expected.size(), n);
+        ASSERT_EQ(expected, found);
+    };
+
+    for (int i = 0; i < 20000; i++) {
+        int lo = point_dist(engine);
+        Interval interval(lo, lo + length_dist(engine));
+        if (engine() % 3 == 0 && !oracle.empty()) {
+            auto it = oracle.lower_bound(interval);
+            Interval victim = it == oracle.end() ? *oracle.begin() : *it;
+            ASSERT_TRUE(rbt.tree_delete(victim));
+            oracle.erase(victim);
+        } else if (oracle.insert(interval).second) {
+            ASSERT_TRUE(rbt.tree_insert(interval, interval.second - interval.first));
+        }
+        if (i % 500 == 0) {
+            ASSERT_TRUE(rbt.check_balanced());
+            int q = point_dist(engine);
+            check_query(q, q);
+            check_query(q, q + length_dist(engine));
+        }
+    }
+    check_query(-10, -1);
+    check_query(20000, 30000);
+    check_query(0, 20000);
+
+    //Max endpoints stay right through bulk_load and the join based operations
+    Tree loaded;
+    std::vector<std::pair<Interval, int>> sorted;
+    for (const Interval &i : oracle) {
+        sorted.emplace_back(i, i.second - i.first);
+    }
+    ASSERT_TRUE(loaded.bulk_load(sorted.begin(), sorted.end()));
+    Tree right;
+    loaded.tree_split(Interval(5000, 0), &right);
+    ASSERT_TRUE(loaded.tree_join(&right));
+    rbt.tree_clear();
+    rbt.tree_union(&loaded);
+    for (int q = 0; q < 10000; q += 997) {
+        check_query(q, q + 50);
+    }
+}
+
+//Check tree against oracle, values are expected to be key * scale
+template <typename Tree>
+void expect_content(Tree *tree, const std::set<int> &oracle, int scale) {
+    ASSERT_TRUE(tree->check_balanced());
+    ASSERT_EQ(oracle.size(), tree->tree_size());
+    auto it = oracle.begin();
+    for (auto node = tree->begin(); node != tree->end(); ++node, ++it) {
+        ASSERT_TRUE(it != oracle.end());
+        ASSERT_EQ(*it, (*node).first);
+        ASSERT_EQ(*it * scale, (*node).second);
+    }
+    ASSERT_TRUE(it == oracle.end());
+}
+
+template <typename Tree>
+void fill(Tree *tree, std::set<int> *oracle, size_t n, int range, int scale,
+          std::default_random_engine *engine) {
+    std::uniform_int_distribution<int> key_dist(0, range);
+    while (oracle->size() < n) {
+        int k = key_dist(*engine);
+        if (oracle->insert(k).second) {
+            ASSERT_TRUE(tree->tree_insert(k, k * scale));
+        }
+    }
+}
+
+TEST(RedBlackTreeSetTest, Test_Join_Split) {
+    std::default_random_engine engine(2021);
+    for (int round = 0; round < 200; round++) {
+        RedBlackTree<int, int> left;
+        RedBlackTree<int, int> right;
+        std::set<int> oracle;
+        fill(&left, &oracle, engine() % 1000, 2000, 1, &engine);
+
+        int k = static_cast<int>(engine() % 2100) - 50;
+        left.tree_split(k, &right);
+        std::set<int> oracle_left(oracle.begin(), oracle.lower_bound(k));
+        std::set<int> oracle_right(oracle.lower_bound(k), oracle.end());
+        expect_content(&left, oracle_left, 1);
+        expect_content(&right, oracle_right, 1);
+
+        if (!oracle_left.empty() && !oracle_right.empty()) {
+            ASSERT_FALSE(right.tree_join(&left));
+        }
+        ASSERT_TRUE(left.tree_join(&right));
+        expect_content(&left, oracle, 1);
+        expect_content(&right, std::set<int>(), 1);
+    }
+
+    //Trees of very different heights
+    RedBlackTree<int, int> small;
+    RedBlackTree<int, int> large;
+    std::set<int> oracle;
+    for (int i = 0; i < 10000; i++) {
+        if (i < 3) {
+            ASSERT_TRUE(small.tree_insert(i, i));
+        } else {
+            ASSERT_TRUE(large.tree_insert(i, i));
+        }
+        oracle.insert(i);
+    }
+    ASSERT_TRUE(small.tree_join(&large));
+    expect_content(&small, oracle, 1);
+    small.tree_split(9998, &large);
+    ASSERT_EQ(2, large.tree_size());
+    ASSERT_TRUE(small.tree_join(&large));
+    expect_content(&small, oracle, 1);
+}
+
+TEST(RedBlackTreeSetTest, Test_Set_Operations) {
+    typedef RedBlackTree<int, int, std::less<int>, NewNodeAllocator,
+                         RedBlackTreeOrderStatistic> Tree;
+    std::default_random_engine engine(2021);
+    const size_t sizes[][2] = {{0, 100}, {100, 0}, {1, 1000}, {1000, 7}, {500, 500},
+                               {3000, 2000}, {300000, 200000}};
+    for (auto &size : sizes) {
+        for (int op = 0; op < 3; op++) {
+            Tree a;
+            Tree b;
+            std::set<int> oracle_a;
+            std::set<int> oracle_b;
+            int range = static_cast<int>(size[0] + size[1]) * 2 + 10;
+            fill(&a, &oracle_a, size[0], range, 1, &engine);
+            fill(&b, &oracle_b, size[1], range, 2, &engine);
+
+            std::set<int> expected;
+            if (op == 0) {
+                a.tree_union(&b);
+                expected = oracle_a;
+                expected.insert(oracle_b.begin(), oracle_b.end());
+            } else if (op == 1) {
+                a.tree_intersection(&b);
+                std::set_intersection(oracle_a.begin(), oracle_a.end(), oracle_b.begin(),
+                                      oracle_b.end(), std::inserter(expected, expected.end()));
+            } else {
+                a.tree_difference(&b);
+                std::set_difference(oracle_a.begin(), oracle_a.end(), oracle_b.begin(),
+                                    oracle_b.end(), std::inserter(expected, expected.end()));
+            }
+            ASSERT_EQ(0, b.tree_size());
+            ASSERT_TRUE(b.begin() == b.end());
+
+            //Keys only in b carry key * 2, the others keep the value of a
+            ASSERT_TRUE(a.check_balanced());
+            ASSERT_EQ(expected.size(), a.tree_size());
+            size_t i = 0;
+            for (int k : expected) {
+                int *v = a.find(k);
+                ASSERT_NE(nullptr, v);
+                ASSERT_EQ(oracle_a.count(k) ? k : k * 2, *v);
+                if (i % 97 == 0) {
+                    ASSERT_EQ(k, (*a.select(i)).first);
+                    ASSERT_EQ(i, a.rank(k));
+                }
+                i++;
+            }
+        }
+    }
+}
+
+TEST(RedBlackTreeSetTest, Test_Split_Then_Set_Operations) {
+    std::default_random_engine engine(2022);
+    for (int round = 0; round < 50; round++) {
+        RedBlackTree<int, int> a;
+        RedBlackTree<int, int> b;
+        std::set<int> oracle_a;
+        std::set<int> oracle_b;
+        fill(&a, &oracle_a, 2000, 8000, 1, &engine);
+        fill(&b, &oracle_b, 500, 8000, 1, &engine);
+        //Deletes shrink black heights which the joins below rely on
+        for (auto it = oracle_a.begin(); it != oracle_a.end();) {
+            if (engine() % 2 == 0) {
+                ASSERT_TRUE(a.tree_delete(*it));
+                it = oracle_a.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        //The sizes stay stale through the set operations
+        RedBlackTree<int, int> right;
+        int k = static_cast<int>(engine() % 8000);
+        a.tree_split(k, &right);
+        b.tree_split(k, &right);
+        std::set<int> expected(oracle_a.begin(), oracle_a.lower_bound(k));
+        if (round % 2 == 0) {
+            a.tree_union(&b);
+            expected.insert(oracle_b.begin(), oracle_b.lower_bound(k));
+        } else {
+            a.tree_difference(&b);
+            for (auto it = oracle_b.begin(); it != oracle_b.lower_bound(k); ++it) {
+                expected.erase(*it);
+            }
+        }
+        expect_content(&a, expected, 1);
+        ASSERT_EQ(0, b.tree_size());
+    }
+}
+
+TEST(CompactRedBlackTreeTest, Test_Random_Ops) {
+    CompactRedBlackTree<int, std::string> rbt;
+    std::map<int, std::string> oracle;
+    std::default_random_engine engine(2021);
+    std::uniform_int_distribution<int> key_dist(0, 999);
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 20000; i++) {
+            int k = key_dist(engine);
+            if (engine() % 3 == 0) {
+                ASSERT_EQ(oracle.erase(k) == 1, rbt.tree_delete(k));
+            } else {
+                bool inserted = oracle.emplace(k, std::to_string(k)).second;
+                ASSERT_EQ(inserted, rbt.tree_insert(k, std::to_string(k)));
+            }
+            if (i % 1000 == 0) {
+                ASSERT_TRUE(rbt.check_balanced());
+                ASSERT_EQ(oracle.size(), rbt.tree_size());
+            }
+        }
+        for (int k = 0; k < 1000; k++) {
+            std::string *v = rbt.find(k);
+            auto it = oracle.find(k);
+            ASSERT_EQ(it != oracle.end(), v != nullptr);
+            if (v != nullptr) {
+                ASSERT_EQ(it->second, *v);
+            }
+        }
+        rbt.tree_clear();
+        oracle.clear();
+        ASSERT_EQ(0, rbt.tree_size());
+    }
+}
+
+//A value counting its live instances, to check that nodes get reclaimed
+struct Counted {
+    Counted(int v = 0) : _v(v) { _live++; }
+    Counted(const Counted &other) : _v(other._v) { _live++; }
+    Counted& operator=(const Counted &other) = default;
+    ~Counted() { _live--; }
+
+    int _v;
+    static std::atomic<int> _live;
+};
+
+std::atomic<int> Counted::_live(0);
+
+TEST(PersistentRedBlackTreeTest, Test_Snapshots) {
+    typedef PersistentRedBlackTree<int, Counted> Tree;
+    std::default_random_engine engine(2021);
+    std::uniform_int_distribution<int> key_dist(0, 999);
+    {
+        Tree tree;
+        std::map<int, int> oracle;
+        std::vector<std::pair<Tree::Snapshot, std::map<int, int>>> snapshots;
+        for (int i = 0; i < 30000; i++) {
+            int k = key_dist(engine);
+            if (engine() % 3 == 0) {
+                ASSERT_EQ(oracle.erase(k) == 1, tree.tree_delete(k));
+            } else {
+                bool inserted = oracle.emplace(k, i).second;
+                ASSERT_EQ(inserted, tree.tree_insert(k, Counted(i)));
+            }
+            if (i % 1000 == 0) {
+                ASSERT_TRUE(tree.check_balanced());
+                ASSERT_EQ(oracle.size(), tree.tree_size());
+                snapshots.emplace_back(tree.snapshot(), oracle);
+            }
+            if (i % 3000 == 1500) {
+                snapshots.erase(snapshots.begin() + engine() % snapshots.size());
+            }
+        }
+
+        //Every snapshot still shows the content at the time it was taken
+        for (auto &snapshot : snapshots) {
+            const Tree::Snapshot &view = snapshot.first;
+            const std::map<int, int> &expected = snapshot.second;
+            ASSERT_EQ(expected.size(), view.tree_size());
+            auto it = expected.begin();
+            size_t n = view.range(0, 1000, [&it](const int &k, const Counted &v) {
+                ASSERT_EQ(it->first, k);
+                ASSERT_EQ(it->second, v._v);
+                ++it;
+            });
+            ASSERT_EQ(expected.size(), n);
+            Counted v;
+            ASSERT_EQ(expected.count(500) == 1, view.tree_find(500, &v));
+            ASSERT_EQ(nullptr, view.find(1000));
+        }
+
+        //Once the snapshots are gone only the live nodes remain
+        snapshots.clear();
+        ASSERT_EQ(static_cast<int>(oracle.size()), Counted::_live.load());
+
+        //Snapshots outlive the tree
+        Tree::Snapshot last = tree.snapshot();
+        tree.tree_clear();
+        ASSERT_EQ(0, tree.tree_size());
+        ASSERT_EQ(oracle.size(), last.tree_size());
+        ASSERT_EQ(static_cast<int>(oracle.size()), Counted::_live.load());
+    }
+    ASSERT_EQ(0, Counted::_live.load());
+}
+
+TEST(PersistentRedBlackTreeTest, Test_Concurrent_Readers) {
+    PersistentRedBlackTree<int, int> tree;
+    std::atomic<bool> stop(false);
+
+    //Every value equals its key, so each view must be sorted, match its own
+    //size and hold no torn value
+    std::thread writer([&tree, &stop]() {
+        std::default_random_engine engine(2021);
+        for (int i = 0; i < 200000; i++) {
+            int k = static_cast<int>(engine() % 1000);
+            if (!tree.tree_insert(k, k)) {
+                tree.tree_delete(k);
+            }
+        }
+        stop = true;
+    });
+
+    std::vector<std::thread> readers;
+    std::atomic<int> torn(0);
+    for (int r = 0; r < 4; r++) {
+        readers.emplace_back([&tree, &stop, &torn]() {
+            while (!stop) {
+                PersistentRedBlackTree<int, int>::Snapshot view = tree.snapshot();
+                int prev = -1;
+                size_t n = view.range(0, 1000, [&prev, &torn](const int &k, const int &v) {
+                    if (k <= prev || v != k) {
+                        torn++;
+                    }
+                    prev = k;
+                });
+                if (n != view.tree_size()) {
+                    torn++;
+                }
+            }
+        });
+    }
+
+    writer.join();
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(0, torn.load());
+    ASSERT_TRUE(tree.check_balanced());
+}
+
+TEST(ConcurrentRedBlackTreeTest, Test_Optimistic_Readers) {
+    //Both halves always hold the same number, so a torn value shows up
+    struct Pair {
+        int _a;
+        int _b;
+    };
+    ConcurrentRedBlackTree<int, Pair> tree;
+    for (int k = 0; k < 2000; k += 2) {
+        ASSERT_TRUE(tree.tree_insert(k, Pair{k, k}));
+    }
+
+    //Even keys stay while the writer churns odd keys and rewrites values,
+    //so readers must never miss an even key nor find a missing one
+    std::atomic<bool> stop(false);
+    std::thread writer([&tree, &stop]() {
+        std::default_random_engine engine(2021);
+        for (int i = 0; i < 200000; i++) {
+            int k = static_cast<int>(engine() % 2000);
+            if (k % 2 == 0) {
+                tree.tree_update(k, Pair{i, i});
+            } else if (!tree.tree_insert(k, Pair{i, i})) {
+                tree.tree_delete(k);
+            }
+        }
+        stop = true;
+    });
+
+    std::atomic<int> errors(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; r++) {
+        readers.emplace_back([&tree, &stop, &errors, r]() {
+            std::default_random_engine engine(r);
+            while (!stop) {
+                int k = static_cast<int>(engine() % 2001);
+                Pair v = {-1, -2};
+                bool found = tree.tree_find(k, &v);
+                if ((k % 2 == 0 && k < 2000 && !found) || (k == 2000 && found) ||
+                    (found && v._a != v._b)) {
+                    errors++;
+                }
+            }
+        });
+    }
+
+    writer.join();
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(0, errors.load());
+    ASSERT_TRUE(tree.check_balanced());
+
+    tree.tree_clear();
+    ASSERT_EQ(0, tree.tree_size());
+    Pair v;
+    ASSERT_FALSE(tree.tree_find(0, &v));
+}
+
+TEST(ConcurrentRedBlackTreeTest, Test_Clear_With_Readers) {
+    ConcurrentRedBlackTree<int, int64_t> tree;
+    for (int k = 0; k < 5000; k++) {
+        ASSERT_TRUE(tree.tree_insert(k, k));
+    }
+
+    //Updates never change what a key maps to, the clear removes every key
+    std::atomic<bool> stop(false);
+    std::atomic<int> errors(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++) {
+        readers.emplace_back([&tree, &stop, &errors, r]() {
+            std::default_random_engine engine(r);
+            while (!stop) {
+                int k = static_cast<int>(engine() % 5000);
+                int64_t v = -1;
+                if (tree.tree_find(k, &v) && v != k) {
+                    errors++;
+                }
+            }
+        });
+    }
+    for (int k = 0; k < 5000; k++) {
+        ASSERT_TRUE(tree.tree_update(k, k));
+    }
+    ASSERT_FALSE(tree.tree_update(5000, 0));
+    tree.tree_clear();
+    ASSERT_EQ(0, tree.tree_size());
+    for (int k = 0; k < 5000; k += 97) {
+        int64_t v = -1;
+        ASSERT_FALSE(tree.tree_find(k, &v));
+    }
+    stop = true;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(0, errors.load());
+    ASSERT_TRUE(tree.tree_insert(1, 1));
+    ASSERT_TRUE(tree.check_balanced());
+}
+
+TEST(FrozenRedBlackTreeTest, Test_Freeze_Thaw) {
+    std::default_random_engine engine(2021);
+    for (size_t n : {0, 1, 2, 3, 7, 8, 100, 1000, 4097}) {
+        RedBlackTree<int, int> rbt;
+        std::set<int> oracle;
+        fill(&rbt, &oracle, n, static_cast<int>(n) * 3, 5, &engine);
+
+        FrozenRedBlackTree<int, int> frozen;
+        frozen.freeze(rbt);
+        ASSERT_EQ(n, frozen.tree_size());
+        for (int k = -1; k <= static_cast<int>(n) * 3 + 1; k++) {
+            const int *v = frozen.find(k);
+            ASSERT_EQ(oracle.count(k) == 1, v != nullptr);
+            if (v != nullptr) {
+                ASSERT_EQ(k * 5, *v);
+            }
+        }
+
+        //Ranges and in-order iteration follow the key order
+        for (int round = 0; round < 20; round++) {
+            int lo = static_cast<int>(engine() % (n * 3 + 2)) - 1;
+            int hi = lo + static_cast<int>(engine() % 50);
+            auto it = oracle.lower_bound(lo);
+            size_t count = frozen.range(lo, hi, [&it](const int &k, const int &v) {
+                ASSERT_EQ(*it, k);
+                ASSERT_EQ(k * 5, v);
+                ++it;
+            });
+            ASSERT_EQ(std::distance(oracle.lower_bound(lo), oracle.lower_bound(hi)), count);
+        }
+        auto it = oracle.begin();
+        for (auto node = frozen.begin(); node != frozen.end(); ++node, ++it) {
+            ASSERT_EQ(*it, node.key());
+        }
+        ASSERT_TRUE(it == oracle.end());
+
+        RedBlackTree<int, int> thawed;
+        thawed.tree_insert(-100, 0);
+        frozen.thaw(&thawed);
+        expect_content(&thawed, oracle, 5);
+    }
+}
+
+TEST(FrozenRedBlackTreeTest, Test_Image) {
+    struct Pod {
+        int64_t _a;
+        double _b;
+    };
+    std::string path = testing::TempDir() + "frozen_red_black_tree_test.img";
+    RedBlackTree<int64_t, Pod> rbt;
+    std::default_random_engine engine(2021);
+    for (int i = 0; i < 10000; i++) {
+        int64_t k = static_cast<int64_t>(engine()) * 1000;
+        rbt.tree_insert(k, Pod{k, k * 0.5});
+    }
+
+    {
+        FrozenRedBlackTree<int64_t, Pod> frozen;
+        frozen.freeze(rbt);
+        ASSERT_TRUE(frozen.save(path.c_str()));
+    }
+
+    FrozenRedBlackTree<int64_t, Pod> mapped;
+    ASSERT_TRUE(mapped.map(path.c_str()));
+    ASSERT_EQ(rbt.tree_size(), mapped.tree_size());
+    for (auto it = rbt.begin(); it != rbt.end(); ++it) {
+        const Pod *v = mapped.find(it.key());
+        ASSERT_NE(nullptr, v);
+        ASSERT_EQ(it.key(), v->_a);
+        ASSERT_EQ(it.value()._b, v->_b);
+        ASSERT_EQ(nullptr, mapped.find(it.key() + 1));
+    }
+
+    RedBlackTree<int64_t, Pod> thawed;
+    mapped.thaw(&thawed);
+    ASSERT_EQ(rbt.tree_size(), thawed.tree_size());
+    ASSERT_TRUE(thawed.check_balanced());
+
+    //An empty tree round trips too
+    RedBlackTree<int64_t, Pod> empty;
+    FrozenRedBlackTree<int64_t, Pod> frozen_empty;
+    frozen_empty.freeze(empty);
+    ASSERT_TRUE(frozen_empty.save(path.c_str()));
+    ASSERT_TRUE(mapped.map(path.c_str()));
+    ASSERT_EQ(0, mapped.tree_size());
+    ASSERT_EQ(nullptr, mapped.find(0));
+
+    //Wrong types, truncated or missing files are refused and keep the content
+    FrozenRedBlackTree<int32_t, Pod> wrong_key;
+    ASSERT_FALSE(wrong_key.map(path.c_str()));
+    mapped.freeze(rbt);
+    FILE *file = fopen(path.c_str(), "r+b");
+    ASSERT_NE(nullptr, file);
+    ASSERT_EQ(0, ftruncate(fileno(file), 20));
+    fclose(file);
+    ASSERT_FALSE(mapped.map(path.c_str()));
+    ASSERT_FALSE(mapped.map("/nonexistent/frozen.img"));
+    ASSERT_EQ(rbt.tree_size(), mapped.tree_size());
+    remove(path.c_str());
+}
+
+TEST(FrozenRedBlackTreeTest, Test_Image_Corrupt_Header) {
+    std::string path = testing::TempDir() + "frozen_red_black_tree_corrupt.img";
+    RedBlackTree<int64_t, int64_t> rbt;
+    for (int64_t i = 0; i < 15; i++) {
+        rbt.tree_insert(i, -i);
+    }
+    FrozenRedBlackTree<int64_t, int64_t> frozen;
+    frozen.freeze(rbt);
+    ASSERT_TRUE(frozen.save(path.c_str()));
+
+    FILE *file = fopen(path.c_str(), "r+b");
+    ASSERT_NE(nullptr, file);
+    FrozenImageHeader good;
+    ASSERT_EQ(1u, fread(&good, sizeof(good), 1, file));
+    auto write_header = [file](const FrozenImageHeader &header) {
+        fseek(file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, file);
+        fflush(file);
+    };
+
+    FrozenRedBlackTree<int64_t, int64_t> mapped;
+    ASSERT_TRUE(mapped.map(path.c_str()));
+
+    //Keys before the mapping: 2^64 - 64 + 16 * 8 wraps to 64
+    FrozenImageHeader bad = good;
+    bad._key_offset = 0 - static_cast<uint64_t>(64);
+    write_header(bad);
+    ASSERT_FALSE(mapped.map(path.c_str()));
+
+    //Keys overlapping the header
+    bad = good;
+    bad._key_offset = 0;
+    write_header(bad);
+    ASSERT_FALSE(mapped.map(path.c_str()));
+
+    //Values wrapping around the same way
+    bad = good;
+    bad._value_offset = 0 - static_cast<uint64_t>(64);
+    write_header(bad);
+    ASSERT_FALSE(mapped.map(path.c_str()));
+
+    //Values running past the end of the file
+    bad = good;
+    bad._value_offset = good._file_size - 64;
+    write_header(bad);
+    ASSERT_FALSE(mapped.map(path.c_str()));
+
+    //More keys than fit between the two offsets
+    bad = good;
+    bad._count = good._count + 16;
+    write_header(bad);
+    ASSERT_FALSE(mapped.map(path.c_str()));
+
+    //The failed maps kept the last good content
+    ASSERT_EQ(15u, mapped.tree_size());
+    ASSERT_EQ(-7, *mapped.find(7));
+    write_header(good);
+    fclose(file);
+    ASSERT_TRUE(mapped.map(path.c_str()));
+    ASSERT_EQ(-14, *mapped.find(14));
+    remove(path.c_str());
+}
+
 int main(int argc, char** argv) {  
     testing::InitGoogleTest(&argc, argv);
 
@@ -0,0 +1,153 @@
+#ifndef SIMPLELIB_RING_BUFFER_HPP_
+#define SIMPLELIB_RING_BUFFER_HPP_
+
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include "common.h"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//Contiguous double-ended ring buffer with the deque subset SimpleBlockingQueue
+//needs. Storage is allocated by reserve() and reused, so a bounded queue runs
+//allocation-free. Pushing past capacity doubles it, like std::vector.
+template<typename ELEM, typename ALLOC = std::allocator<ELEM>>
+class RingBuffer {
+ public:
+  typedef ELEM value_type;
+  typedef std::allocator_traits<ALLOC> AllocTraits;
+
+  RingBuffer() = default;
+  explicit RingBuffer(size_t capacity) {
+    reserve(capacity);
+  }
+  ~RingBuffer() {
+    clear();
+    AllocTraits::deallocate(alloc_, buffer_, capacity_);
+  }
+
+  RingBuffer(const RingBuffer &) = delete;
+  RingBuffer &operator=(const RingBuffer &) = delete;
+
+  //Grow the storage to hold at least n elements, rounded up to a power of two
+  void reserve(size_t n) {
+    if (n <= capacity_) {
+      return;
+    }
+    size_t capacity = 1;
+    while (capacity < n) {
+      capacity <<= 1;
+    }
+    ELEM *buffer = AllocTraits::allocate(alloc_, capacity);
+    for (size_t i = 0; i < size_; ++i) {
+      ELEM &e = at(i);
+      AllocTraits::construct(alloc_, buffer + i, std::move(e));
+      AllocTraits::destroy(alloc_, &e);
+    }
+    AllocTraits::deallocate(alloc_, buffer_, capacity_);
+    buffer_ = buffer;
+    capacity_ = capacity;
+    head_ = 0;
+  }
+
+  template<typename... Args>
+  void emplace_back(Args &&... args) {
+    if (size_ == capacity_) {
+      //args may refer to one of our elements, build it before the storage moves
+      ELEM e(std::forward<Args>(args)...);
+      grow();
+      AllocTraits::construct(alloc_, &at(size_), std::move(e));
+    } else {
+      AllocTraits::construct(alloc_, &at(size_), std::forward<Args>(args)...);
+    }
+    ++size_;
+  }
+
+  template<typename... Args>
+  void emplace_front(Args &&... args) {
+    if (size_ == capacity_) {
+      ELEM e(std::forward<Args>(args)...);
+      grow();
+      head_ = (head_ - 1) & (capacity_ - 1);
+      AllocTraits::construct(alloc_, buffer_ + head_, std::move(e));
+    } else {
+      size_t head = (head_ - 1) & (capacity_ - 1);
+      AllocTraits::construct(alloc_, buffer_ + head, std::forward<Args>(args)...);
+      head_ = head;
+    }
+    ++size_;
+  }
+
+  void push_back(const ELEM &e) {
+    emplace_back(e);
+  }
+
+  void push_back(ELEM &&e) {
+    emplace_back(std::move(e));
+  }
+
+  void push_front(const ELEM &e) {
+    emplace_front(e);
+  }
+
+  void push_front(ELEM &&e) {
+    emplace_front(std::move(e));
+  }
+
+  void pop_front() {
+    AllocTraits::destroy(alloc_, &at(0));
+    head_ = (head_ + 1) & (capacity_ - 1);
+    --size_;
+  }
+
+  void pop_back() {
+    AllocTraits::destroy(alloc_, &at(size_ - 1));
+    --size_;
+  }
+
+  ELEM &front() {
+    return at(0);
+  }
+
+  ELEM &back() {
+    return at(size_ - 1);
+  }
+
+  //Destroys the elements but keeps the storage
+  void clear() {
+    while (size_ > 0) {
+      pop_back();
+    }
+    head_ = 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+ private:
+  void grow() {
+    reserve(capacity_ == 0 ? 1 : capacity_ * 2);
+  }
+
+  ELEM &at(size_t i) {
+    return buffer_[(head_ + i) & (capacity_ - 1)];
+  }
+
+  ALLOC alloc_;
+  ELEM *buffer_ = nullptr;
+  size_t capacity_ = 0;
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif // SIMPLELIB_RING_BUFFER_HPP_
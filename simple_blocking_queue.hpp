@@ -5,8 +5,11 @@
 #include <deque>
 #include <mutex>
 #include <memory>
+#include <vector>
 #include <chrono>
 #include <limits>
+#include <iterator>
+#include <algorithm>
 #include <cstdint>
 #include <functional>
 #include <condition_variable>
@@ -16,11 +19,14 @@ BEGIN_NAMESPACE_SIMPLELIB
 
 template<typename T,
     template<typename ELEM, typename ALLOC = std::allocator<ELEM>>
-    class CONT = std::deque>
+    class CONT = std::deque,
+    typename COND = std::condition_variable>
 class SimpleBlockingQueue {
  public:
   SimpleBlockingQueue() = default;
-  explicit SimpleBlockingQueue(std::uint32_t max_size) : max_size_(max_size) {}
+  explicit SimpleBlockingQueue(std::uint32_t max_size) : max_size_(max_size) {
+    Reserve(&queue_, max_size, 0);
+  }
   virtual ~SimpleBlockingQueue() {
     queue_.clear();
   }
@@ -29,14 +35,14 @@ class SimpleBlockingQueue {
     std::unique_lock<std::mutex> locker(mutex_);
     not_full_.wait(locker, [this]() { return queue_.size() < max_size_.load(); });
     queue_.push_back(t);
-    not_empty_.notify_one();
+    NotifyNotEmpty(1);
   }
 
   void PushFront(const T &t) {
     std::unique_lock<std::mutex> locker(mutex_);
     not_full_.wait(locker, [this]() { return queue_.size() < max_size_.load(); });
     queue_.push_front(t);
-    not_empty_.notify_one();
+    NotifyNotEmpty(1);
   }
 
   bool PushBackWithTimeout(const T &t, int timeout/*in milliseconds*/) {
@@ -45,7 +51,7 @@ class SimpleBlockingQueue {
                            std::chrono::milliseconds(timeout),
                            [this]() { return queue_.size() < max_size_.load(); })) {
       queue_.push_back(t);
-      not_empty_.notify_one();
+      NotifyNotEmpty(1);
       return true;
     }
     //timeout
@@ -58,19 +64,56 @@ class SimpleBlockingQueue {
                            std::chrono::milliseconds(timeout),
                            [this]() { return queue_.size() < max_size_.load(); })) {
       queue_.push_front(t);
-      not_empty_.notify_one();
+      NotifyNotEmpty(1);
       return true;
     }
     //timeout
     return false;
   }
 
+  void PushBack(T &&t) {
+    EmplaceBack(std::move(t));
+  }
+
+  void PushFront(T &&t) {
+    EmplaceFront(std::move(t));
+  }
+
+  bool PushBackWithTimeout(T &&t, int timeout/*in milliseconds*/) {
+    return EmplaceBackWithTimeout(timeout, std::move(t));
+  }
+
+  bool PushFrontWithTimeout(T &&t, int timeout/*in milliseconds*/) {
+    return EmplaceFrontWithTimeout(timeout, std::move(t));
+  }
+
+  //Never blocks, returns false if the queue is full
+  bool TryPushBack(const T &t) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (queue_.size() >= max_size_.load()) {
+      return false;
+    }
+    queue_.push_back(t);
+    NotifyNotEmpty(1);
+    return true;
+  }
+
+  bool TryPushBack(T &&t) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (queue_.size() >= max_size_.load()) {
+      return false;
+    }
+    queue_.push_back(std::move(t));
+    NotifyNotEmpty(1);
+    return true;
+  }
+
   template<typename... Args>
   void EmplaceBack(Args &&... args) {
     std::unique_lock<std::mutex> locker(mutex_);
     not_full_.wait(locker, [this]() { return queue_.size() < max_size_.load(); });
     queue_.emplace_back(std::forward<Args>(args)...);
-    not_empty_.notify_one();
+    NotifyNotEmpty(1);
   }
 
   template<typename... Args>
@@ -78,7 +121,7 @@ class SimpleBlockingQueue {
     std::unique_lock<std::mutex> locker(mutex_);
     not_full_.wait(locker, [this]() { return queue_.size() < max_size_.load(); });
     queue_.emplace_front(std::forward<Args>(args)...);
-    not_empty_.notify_one();
+    NotifyNotEmpty(1);
   }
 
   template<typename... Args>
@@ -88,7 +131,7 @@ class SimpleBlockingQueue {
                            std::chrono::milliseconds(timeout),
                            [this]() { return queue_.size() < max_size_.load(); })) {
       queue_.emplace_back(std::forward<Args>(args)...);
-      not_empty_.notify_one();
+      NotifyNotEmpty(1);
       return true;
     }
     //timeout
@@ -102,13 +145,33 @@ class SimpleBlockingQueue {
                            std::chrono::milliseconds(timeout),
                            [this]() { return queue_.size() < max_size_.load(); })) {
       queue_.emplace_front(std::forward<Args>(args)...);
-      not_empty_.notify_one();
+      NotifyNotEmpty(1);
       return true;
     }
     //timeout
     return false;
   }
 
+  //Push [first, last) to the back, taking the lock once per run of free slots
+  //rather than once per element. Blocks while the queue is full.
+  template<typename InputIt>
+  void PushBackBatch(InputIt first, InputIt last) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    while (first != last) {
+      not_full_.wait(locker, [this]() { return queue_.size() < max_size_.load(); });
+      size_t pushed = 0;
+      for (; first != last && queue_.size() < max_size_.load(); ++first, ++pushed) {
+        queue_.push_back(*first);
+      }
+      NotifyNotEmpty(pushed);
+    }
+  }
+
+  template<typename Range>
+  void PushBackBatch(const Range &range) {
+    PushBackBatch(std::begin(range), std::end(range));
+  }
+
   void PopFront(T *t) {
     std::unique_lock<std::mutex> locker(mutex_);
     not_empty_.wait(locker, [this]() { return !queue_.empty(); });
@@ -120,11 +183,42 @@ class SimpleBlockingQueue {
   void PopBack(T *t) {
     std::unique_lock<std::mutex> locker(mutex_);
     not_empty_.wait(locker, [this]() { return !queue_.empty(); });
-    (*t) = std::move(queue_.front());
+    (*t) = std::move(queue_.back());
     queue_.pop_back();
     not_full_.notify_one();
   }
 
+  //Blocking pops returning the value, T needs no default constructor
+  T PopFront() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    not_empty_.wait(locker, [this]() { return !queue_.empty(); });
+    T t(std::move(queue_.front()));
+    queue_.pop_front();
+    not_full_.notify_one();
+    return t;
+  }
+
+  T PopBack() {
+    std::unique_lock<std::mutex> locker(mutex_);
+    not_empty_.wait(locker, [this]() { return !queue_.empty(); });
+    T t(std::move(queue_.back()));
+    queue_.pop_back();
+    not_full_.notify_one();
+    return t;
+  }
+
+  //Never blocks, returns false if the queue is empty
+  bool TryPopFront(T *t) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (queue_.empty()) {
+      return false;
+    }
+    (*t) = std::move(queue_.front());
+    queue_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
   bool PopFrontWithTimeout(T *t, int timeout/*in milliseconds*/) {
     std::unique_lock<std::mutex> locker(mutex_);
     if (not_empty_.wait_for(locker,
@@ -144,7 +238,7 @@ class SimpleBlockingQueue {
     if (not_empty_.wait_for(locker,
                             std::chrono::milliseconds(timeout),
                             [this]() { return !queue_.empty(); })) {
-      (*t) = std::move(queue_.front());
+      (*t) = std::move(queue_.back());
       queue_.pop_back();
       not_full_.notify_one();
       return true;
@@ -153,8 +247,53 @@ class SimpleBlockingQueue {
     return false;
   }
 
+  //Append up to max_n items from the front to *out under one lock acquisition.
+  //Blocks until at least one item is available, returns the number of items moved.
+  size_t PopFrontBatch(std::vector<T> *out, size_t max_n) {
+    if (max_n == 0) {
+      return 0;
+    }
+    std::unique_lock<std::mutex> locker(mutex_);
+    not_empty_.wait(locker, [this]() { return !queue_.empty(); });
+    return DrainFront(out, max_n);
+  }
+
+  //Like PopFrontBatch, but lingers until max_n items (or a full queue) are available
+  //or timeout expires, whichever comes first. Returns 0 if nothing arrived in time.
+  size_t PopFrontBatchWithLinger(std::vector<T> *out, size_t max_n,
+                                 int timeout/*in milliseconds*/) {
+    if (max_n == 0) {
+      return 0;
+    }
+    std::unique_lock<std::mutex> locker(mutex_);
+    size_t threshold = std::min<size_t>(max_n, max_size_.load());
+    if (lingering_++ == 0 || threshold < linger_threshold_) {
+      linger_threshold_ = threshold;
+    }
+    linger_.wait_for(locker,
+                     std::chrono::milliseconds(timeout),
+                     [this, max_n]() {
+                       return queue_.size() >= std::min<size_t>(max_n, max_size_.load());
+                     });
+    if (--lingering_ == 0) {
+      linger_threshold_ = std::numeric_limits<size_t>::max();
+    }
+    //timeout or enough items, take whatever is there
+    return DrainFront(out, max_n);
+  }
+
+  //Containers with reserve() (e.g. RingBuffer) allocate up to kMaxReserve
+  //slots of the bound here, they grow on demand past that
   void SetMaxSize(uint32_t max_size) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    Reserve(&queue_, max_size, 0);
     max_size_.store(max_size);
+    not_full_.notify_all();
+    //A smaller bound may complete a lingering batch
+    if (lingering_ > 0) {
+      linger_threshold_ = std::min<size_t>(linger_threshold_, max_size);
+      linger_.notify_all();
+    }
   }
 
   void Clear() {
@@ -162,6 +301,19 @@ class SimpleBlockingQueue {
     queue_.clear();
   }
 
+  //Also call notify(notifier, n) whenever n items arrive, nullptr to detach.
+  //Used by QueueSelector to wait on many queues with one EventCount. The hook
+  //is type erased, so the queue does not depend on the notifier's type.
+  void SetNotifier(void *notifier, void (*notify)(void *, int)) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (notifier == nullptr || notify == nullptr) {
+      notifier = nullptr;
+      notify = nullptr;
+    }
+    notifier_ = notifier;
+    notify_ = notify;
+  }
+
   size_t Size() {
     std::lock_guard<std::mutex> locker(mutex_);
     return queue_.size();
@@ -172,10 +324,61 @@ class SimpleBlockingQueue {
     return queue_.empty();
   }
  private:
+  //Largest eager reserve, so a huge bound does not allocate it all at once
+  static constexpr std::uint32_t kMaxReserve = 65536;
+
+  template<typename C>
+  static auto Reserve(C *c, std::uint32_t max_size, int) -> decltype(c->reserve(max_size), void()) {
+    if (max_size != std::numeric_limits<std::uint32_t>::max()) {
+      c->reserve(max_size < kMaxReserve ? max_size : kMaxReserve);
+    }
+  }
+
+  template<typename C>
+  static void Reserve(C *, std::uint32_t, long) {}
+
+  //Wake waiters for n new items (or free slots): nobody for 0, one waiter for 1,
+  //all of them only when several could make progress
+  static void Notify(COND *cond, size_t n) {
+    if (n == 1) {
+      cond->notify_one();
+    } else if (n > 1) {
+      cond->notify_all();
+    }
+  }
+
+  //Lingering batch consumers wait on their own condition and are only woken
+  //once the queue reaches the smallest threshold among them, which may be
+  //stale (lower) after a lingerer left, so they recheck and wait again
+  void NotifyNotEmpty(size_t n) {
+    Notify(&not_empty_, n);
+    if (lingering_ > 0 && n > 0 && queue_.size() >= linger_threshold_) {
+      linger_.notify_all();
+    }
+    if (notifier_ != nullptr && n > 0) {
+      notify_(notifier_, static_cast<int>(std::min<size_t>(n, std::numeric_limits<int>::max())));
+    }
+  }
+
+  size_t DrainFront(std::vector<T> *out, size_t max_n) {
+    size_t n = std::min(max_n, queue_.size());
+    for (size_t i = 0; i < n; ++i) {
+      out->push_back(std::move(queue_.front()));
+      queue_.pop_front();
+    }
+    Notify(&not_full_, n);
+    return n;
+  }
+
   CONT<T> queue_;
   std::mutex mutex_;
-  std::condition_variable not_empty_;
-  std::condition_variable not_full_;
+  COND not_empty_;
+  COND not_full_;
+  COND linger_;
+  size_t lingering_ = 0;  //guarded by mutex_
+  size_t linger_threshold_ = std::numeric_limits<size_t>::max();  //guarded by mutex_
+  void *notifier_ = nullptr;  //guarded by mutex_
+  void (*notify_)(void *, int) = nullptr;  //guarded by mutex_
   std::atomic<uint32_t> max_size_{std::numeric_limits<std::uint32_t>::max()};
 };
 
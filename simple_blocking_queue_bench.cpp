@@ -0,0 +1,397 @@
+#include <new>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <queue>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+#include "simple_blocking_queue.hpp"
+#include "ring_buffer.hpp"
+#include "two_lock_blocking_queue.hpp"
+#include "futex.hpp"
+#include "priority_blocking_queue.hpp"
+#include "work_stealing_deque.hpp"
+#include "queue_selector.hpp"
+
+using namespace simplelib;
+
+//Count every heap allocation made by the process
+static std::atomic<size_t> g_allocations{0};
+
+void *operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+//Run func once and return the elapsed wall time in milliseconds
+template <typename Func>
+double time_ms(Func func) {
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+//Move n items per producer through a bounded queue with the given thread counts
+template <typename Queue>
+void bench_queue(const char *name, int producers, int consumers, size_t n, uint32_t bound) {
+    Queue queue(bound);
+    std::atomic<long> sum{0};
+    size_t total = n * producers;
+    size_t allocations = g_allocations.load();
+
+    double elapsed = time_ms([&]() {
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; p++) {
+            threads.emplace_back([&]() {
+                for (size_t i = 0; i < n; i++) {
+                    queue.PushBack(static_cast<long>(i));
+                }
+            });
+        }
+        for (int c = 0; c < consumers; c++) {
+            //Split total among consumers, the first ones take the remainder
+            size_t share = total / consumers + (static_cast<size_t>(c) < total % consumers ? 1 : 0);
+            threads.emplace_back([&, share]() {
+                long local = 0;
+                for (size_t i = 0; i < share; i++) {
+                    local += queue.PopFront();
+                }
+                sum += local;
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+    });
+
+    //Allocations include the thread bookkeeping, which is the same for every queue
+    allocations = g_allocations.load() - allocations;
+    printf("%-12s %dP/%dC  %7.2f Mops/s  %8zu allocations%s\n", name, producers, consumers,
+           total / 1000.0 / elapsed, allocations, sum == 0 ? " !" : "");
+}
+
+//Nanoseconds on the steady clock, used to stamp items
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Bursty traffic: one producer pushes bursts of stamped items with idle gaps in
+//between, consumers record push-to-pop latency
+template <typename Queue>
+void bench_latency(const char *name, int consumers, int bursts, int burst_size, int gap_us) {
+    Queue queue;
+    std::vector<std::vector<int64_t>> latencies(consumers);
+    size_t total = static_cast<size_t>(bursts) * burst_size;
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&, c]() {
+            std::vector<int64_t> &mine = latencies[c];
+            for (;;) {
+                int64_t stamp = queue.PopFront();
+                if (stamp < 0) {
+                    break;
+                }
+                mine.push_back(now_ns() - stamp);
+            }
+        });
+    }
+    for (int b = 0; b < bursts; b++) {
+        for (int i = 0; i < burst_size; i++) {
+            queue.PushBack(now_ns());
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(gap_us));
+    }
+    for (int c = 0; c < consumers; c++) {
+        queue.PushBack(-1);
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    std::vector<int64_t> all;
+    for (auto &mine : latencies) {
+        all.insert(all.end(), mine.begin(), mine.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto pct = [&](double p) {
+        return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))] / 1000.0;
+    };
+    printf("%-12s %dC  p50 %8.2f us  p99 %8.2f us  p99.9 %8.2f us  max %9.2f us%s\n",
+           name, consumers, pct(0.5), pct(0.99), pct(0.999), all.back() / 1000.0,
+           all.size() != total ? " !" : "");
+}
+
+//CPU time consumed by the calling thread in milliseconds
+double thread_cpu_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+//One dispatcher serves several queues fed with sparse stamped items: either by
+//polling each with a 1 ms timed pop, or blocking in a QueueSelector
+void bench_select(bool select, size_t queues, int items, int gap_us) {
+    std::vector<SimpleBlockingQueue<int64_t>> sources(queues);
+    QueueSelector<int64_t> selector;
+    for (auto &q : sources) {
+        selector.Add(&q);
+    }
+
+    std::vector<int64_t> latencies;
+    double cpu = 0;
+    std::thread dispatcher([&]() {
+        double begin = thread_cpu_ms();
+        int64_t stamp;
+        size_t next = 0;
+        while (latencies.size() < static_cast<size_t>(items)) {
+            bool got = false;
+            if (select) {
+                selector.PopFront(&stamp);
+                got = true;
+            } else {
+                got = sources[next].PopFrontWithTimeout(&stamp, 1);
+                next = (next + 1) % queues;
+            }
+            if (got) {
+                latencies.push_back(now_ns() - stamp);
+            }
+        }
+        cpu = thread_cpu_ms() - begin;
+    });
+    double elapsed = time_ms([&]() {
+        std::default_random_engine engine(2021);
+        for (int i = 0; i < items; i++) {
+            sources[engine() % queues].PushBack(now_ns());
+            std::this_thread::sleep_for(std::chrono::microseconds(gap_us));
+        }
+        dispatcher.join();
+    });
+
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))] / 1000.0;
+    };
+    printf("%-12s %zu queues  p50 %8.2f us  p99 %8.2f us  dispatcher cpu %5.1f%%\n",
+           select ? "selector" : "timed polls", queues, pct(0.5), pct(0.99), 100.0 * cpu / elapsed);
+}
+
+//Single thread: push random keys, then pop them all in priority order
+template <typename Queue>
+void bench_heap(const char *name, const std::vector<long> &keys) {
+    Queue queue;
+    double push = time_ms([&]() {
+        for (long k : keys) {
+            queue.PushBack(k);
+        }
+    });
+
+    long last = std::numeric_limits<long>::max();
+    bool sorted = true;
+    double pop = time_ms([&]() {
+        for (size_t i = 0; i < keys.size(); i++) {
+            long k = queue.PopFront();
+            sorted = sorted && k <= last;
+            last = k;
+        }
+    });
+
+    double mops = keys.size() / 1000.0;
+    printf("%-12s push %6.2f Mops/s  pop %6.2f Mops/s%s\n",
+           name, mops / push, mops / pop, sorted ? "" : " !");
+}
+
+//std::priority_queue behind one mutex, adapted to the queue interface
+class StdPriorityQueue {
+public:
+    void PushBack(long k) {
+        std::lock_guard<std::mutex> locker(mutex_);
+        queue_.push(k);
+    }
+
+    long PopFront() {
+        std::lock_guard<std::mutex> locker(mutex_);
+        long k = queue_.top();
+        queue_.pop();
+        return k;
+    }
+
+private:
+    std::mutex mutex_;
+    std::priority_queue<long> queue_;
+};
+
+//Owner pushes n tasks in chunks of 64 and pops them LIFO while thieves steal
+//from the other end, the pattern of a fork/join scheduler
+template <typename PushPop>
+void bench_owner(const char *name, size_t n, int thieves, PushPop push_pop) {
+    std::atomic<long> stolen{0};
+    long owned = 0;
+    double elapsed = time_ms([&]() {
+        owned = push_pop(n, thieves, &stolen);
+    });
+    printf("%-16s %d thieves  %7.2f Mops/s  stolen %5.1f%%%s\n", name, thieves,
+           n / 1000.0 / elapsed, 100.0 * stolen.load() / n,
+           static_cast<size_t>(owned + stolen.load()) != n ? " !" : "");
+}
+
+long deque_push_pop(size_t n, int thieves, std::atomic<long> *stolen) {
+    WorkStealingDeque<long> deque;
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thieves; t++) {
+        threads.emplace_back([&]() {
+            long v;
+            while (!done.load(std::memory_order_relaxed)) {
+                if (deque.Steal(&v)) {
+                    stolen->fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    long owned = 0;
+    long v;
+    for (size_t i = 0; i < n; i += 64) {
+        for (size_t j = i; j < std::min(n, i + 64); j++) {
+            deque.PushBottom(static_cast<long>(j));
+        }
+        while (deque.PopBottom(&v)) {
+            owned++;
+        }
+    }
+    done = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+    return owned;
+}
+
+//std::deque behind one mutex with non-blocking pops at both ends
+class MutexDeque {
+public:
+    void PushBack(long v) {
+        std::lock_guard<std::mutex> locker(mutex_);
+        deque_.push_back(v);
+    }
+
+    bool TryPopBack(long *v) {
+        std::lock_guard<std::mutex> locker(mutex_);
+        if (deque_.empty()) {
+            return false;
+        }
+        *v = deque_.back();
+        deque_.pop_back();
+        return true;
+    }
+
+    bool TryPopFront(long *v) {
+        std::lock_guard<std::mutex> locker(mutex_);
+        if (deque_.empty()) {
+            return false;
+        }
+        *v = deque_.front();
+        deque_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<long> deque_;
+};
+
+long locked_push_pop(size_t n, int thieves, std::atomic<long> *stolen) {
+    MutexDeque deque;
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thieves; t++) {
+        threads.emplace_back([&]() {
+            long v;
+            while (!done.load(std::memory_order_relaxed)) {
+                if (deque.TryPopFront(&v)) {
+                    stolen->fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    long owned = 0;
+    long v;
+    for (size_t i = 0; i < n; i += 64) {
+        for (size_t j = i; j < std::min(n, i + 64); j++) {
+            deque.PushBack(static_cast<long>(j));
+        }
+        while (deque.TryPopBack(&v)) {
+            owned++;
+        }
+    }
+    done = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+    return owned;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    uint32_t bound = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : 1024;
+
+    printf("== %zu items per producer, max size %u, %u hardware threads ==\n",
+           n, bound, std::thread::hardware_concurrency());
+    for (int threads : {1, 4}) {
+        bench_queue<SimpleBlockingQueue<long>>("deque", threads, threads, n, bound);
+        bench_queue<SimpleBlockingQueue<long, RingBuffer>>("ring buffer", threads, threads, n, bound);
+        bench_queue<TwoLockBlockingQueue<long>>("two-lock", threads, threads, n, bound);
+        bench_queue<SimpleBlockingQueue<long, std::deque, SpinFutexCondition>>(
+            "spin-futex", threads, threads, n, bound);
+    }
+
+    printf("== Bursty latency: 2000 bursts of 16 items, 200 us gaps ==\n");
+    for (int consumers : {1, 4}) {
+        bench_latency<SimpleBlockingQueue<int64_t>>("condvar", consumers, 2000, 16, 200);
+        bench_latency<SimpleBlockingQueue<int64_t, std::deque, SpinFutexCondition>>(
+            "spin-futex", consumers, 2000, 16, 200);
+    }
+
+    std::vector<long> keys(n);
+    std::default_random_engine engine(2021);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = static_cast<long>(engine());
+    }
+
+    printf("== Priority order: %zu random keys ==\n", n);
+    bench_heap<StdPriorityQueue>("std binary", keys);
+    bench_heap<PriorityBlockingQueue<long, std::less<long>, 2>>("2-ary", keys);
+    bench_heap<PriorityBlockingQueue<long, std::less<long>, 4>>("4-ary", keys);
+    bench_heap<PriorityBlockingQueue<long, std::less<long>, 8>>("8-ary", keys);
+    bench_heap<PriorityBlockingQueue<long, std::less<long>, 4, true>>("4-ary fifo", keys);
+
+    printf("== One dispatcher, 4000 items 250 us apart ==\n");
+    bench_select(false, 4, 4000, 250);
+    bench_select(true, 4, 4000, 250);
+
+    printf("== Work stealing: %zu tasks ==\n", n);
+    for (int thieves : {0, 3}) {
+        bench_owner("mutex deque", n, thieves, locked_push_pop);
+        bench_owner("chase-lev deque", n, thieves, deque_push_pop);
+    }
+
+    return 0;
+}
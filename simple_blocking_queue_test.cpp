@@ -0,0 +1,503 @@
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "futex.hpp"
+#include "queue_selector.hpp"
+#include "ring_buffer.hpp"
+#include "simple_blocking_queue.hpp"
+
+using namespace simplelib;
+
+//Move-only and without a default constructor
+class Token {
+public:
+    explicit Token(int id) : _id(new int(id)) {}
+    Token(Token &&other) = default;
+    Token &operator=(Token &&other) = default;
+
+    int id() const {
+        return _id ? *_id : -1;
+    }
+private:
+    std::unique_ptr<int> _id;
+};
+
+TEST(SimpleBlockingQueueTest, Test_Move_Only) {
+    SimpleBlockingQueue<Token> queue(5);
+    queue.PushBack(Token(2));
+    queue.PushFront(Token(1));
+    ASSERT_TRUE(queue.PushBackWithTimeout(Token(3), 0));
+    ASSERT_TRUE(queue.TryPushBack(Token(4)));
+    queue.EmplaceBack(5);
+    ASSERT_EQ(5, queue.Size());
+
+    //A failed push leaves its argument alone
+    Token rejected(6);
+    ASSERT_FALSE(queue.TryPushBack(std::move(rejected)));
+    ASSERT_FALSE(queue.PushFrontWithTimeout(std::move(rejected), 1));
+    ASSERT_EQ(6, rejected.id());
+
+    ASSERT_EQ(1, queue.PopFront().id());
+    ASSERT_EQ(5, queue.PopBack().id());
+    ASSERT_EQ(4, queue.PopBack().id());
+    queue.EmplaceFront(0);
+    ASSERT_EQ(0, queue.PopFront().id());
+    ASSERT_EQ(2, queue.PopFront().id());
+    ASSERT_EQ(3, queue.PopBack().id());
+    ASSERT_TRUE(queue.Empty());
+}
+
+TEST(SimpleBlockingQueueTest, Test_Pop_Back) {
+    //PopBack and PopBackWithTimeout take from the back, PopFront from the front
+    SimpleBlockingQueue<std::unique_ptr<int>> queue;
+    for (int i = 0; i < 4; i++) {
+        queue.PushBack(std::unique_ptr<int>(new int(i)));
+    }
+    std::unique_ptr<int> t;
+    queue.PopBack(&t);
+    ASSERT_EQ(3, *t);
+    ASSERT_TRUE(queue.PopBackWithTimeout(&t, 0));
+    ASSERT_EQ(2, *t);
+    queue.PopFront(&t);
+    ASSERT_EQ(0, *t);
+    ASSERT_TRUE(queue.PopFrontWithTimeout(&t, 0));
+    ASSERT_EQ(1, *t);
+    ASSERT_FALSE(queue.PopBackWithTimeout(&t, 1));
+    ASSERT_FALSE(queue.PopFrontWithTimeout(&t, 1));
+}
+
+TEST(SimpleBlockingQueueTest, Test_Try) {
+    SimpleBlockingQueue<std::string> queue(2);
+    std::string s;
+    ASSERT_FALSE(queue.TryPopFront(&s));
+    std::string a = "a";
+    ASSERT_TRUE(queue.TryPushBack(a));
+    ASSERT_TRUE(queue.TryPushBack(std::string("b")));
+    ASSERT_FALSE(queue.TryPushBack(a));
+    ASSERT_EQ("a", a);
+    ASSERT_TRUE(queue.TryPopFront(&s));
+    ASSERT_EQ("a", s);
+    ASSERT_TRUE(queue.TryPopFront(&s));
+    ASSERT_EQ("b", s);
+    ASSERT_FALSE(queue.TryPopFront(&s));
+}
+
+TEST(SimpleBlockingQueueTest, Test_Blocking_Pop) {
+    //A value-returning pop waits for the producer
+    SimpleBlockingQueue<Token> queue(1);
+    std::thread producer([&queue]() {
+        for (int i = 0; i < 1000; i++) {
+            queue.PushBack(Token(i));
+        }
+    });
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(i, queue.PopFront().id());
+    }
+    producer.join();
+}
+
+TEST(RingBufferTest, Test_Wrap_Around) {
+    RingBuffer<std::string> ring(8);
+    ASSERT_EQ(8, ring.capacity());
+    int next_in = 0;
+    int next_out = 0;
+    //Walk the head around the storage several times, then grow while wrapped
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 5; i++) {
+            ring.push_back(std::to_string(next_in++));
+        }
+        for (int i = 0; i < 4; i++) {
+            ASSERT_EQ(std::to_string(next_out++), ring.front());
+            ring.pop_front();
+        }
+    }
+    ASSERT_EQ(20, ring.size());
+    ASSERT_EQ(32, ring.capacity());
+    while (!ring.empty()) {
+        ASSERT_EQ(std::to_string(next_out++), ring.front());
+        ring.pop_front();
+    }
+    ASSERT_EQ(next_in, next_out);
+
+    //Both ends
+    ring.push_front("b");
+    ring.push_front("a");
+    ring.push_back("c");
+    ASSERT_EQ("a", ring.front());
+    ASSERT_EQ("c", ring.back());
+    ring.pop_back();
+    ASSERT_EQ("b", ring.back());
+    ring.clear();
+    ASSERT_TRUE(ring.empty());
+    ASSERT_EQ(32, ring.capacity());
+}
+
+TEST(RingBufferTest, Test_Queue_Both_Ends) {
+    SimpleBlockingQueue<int, RingBuffer> queue(4);
+    for (int round = 0; round < 10; round++) {
+        queue.PushFront(2);
+        queue.PushFront(1);
+        queue.PushBack(3);
+        queue.PushBack(4);
+        ASSERT_FALSE(queue.TryPushBack(5));
+        int t = 0;
+        queue.PopBack(&t);
+        ASSERT_EQ(4, t);
+        queue.PopFront(&t);
+        ASSERT_EQ(1, t);
+        ASSERT_EQ(3, queue.PopBack());
+        ASSERT_EQ(2, queue.PopBack());
+        ASSERT_TRUE(queue.Empty());
+    }
+}
+
+//std::allocator that counts the bytes it hands out
+template <typename T>
+struct CountingAllocator : std::allocator<T> {
+    static size_t bytes;
+
+    template <typename U>
+    struct rebind {
+        typedef CountingAllocator<U> other;
+    };
+
+    CountingAllocator() = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        bytes += n * sizeof(T);
+        return std::allocator<T>::allocate(n);
+    }
+};
+
+template <typename T>
+size_t CountingAllocator<T>::bytes = 0;
+
+//The queue passes std::allocator, swap in the counting one
+template <typename ELEM, typename ALLOC>
+using CountingRingBuffer = RingBuffer<ELEM, CountingAllocator<ELEM>>;
+
+TEST(RingBufferTest, Test_Max_Size_Reserve) {
+    //A huge bound reserves a capped amount up front and grows on demand
+    SimpleBlockingQueue<int, CountingRingBuffer> queue(16);
+    ASSERT_EQ(16 * sizeof(int), CountingAllocator<int>::bytes);
+    queue.SetMaxSize(1u << 30);
+    ASSERT_GE((16 + 65536) * sizeof(int), CountingAllocator<int>::bytes);
+    for (int i = 0; i < 100000; i++) {
+        queue.PushBack(i);
+    }
+    for (int i = 0; i < 100000; i++) {
+        ASSERT_EQ(i, queue.PopFront());
+    }
+}
+
+//std::condition_variable counting every notify_all
+class CountingCondition {
+public:
+    static std::atomic<int> notify_alls;
+
+    void wait(std::unique_lock<std::mutex> &locker) {
+        _cond.wait(locker);
+    }
+
+    template <typename Predicate>
+    void wait(std::unique_lock<std::mutex> &locker, Predicate pred) {
+        _cond.wait(locker, pred);
+    }
+
+    template <typename Rep, typename Period, typename Predicate>
+    bool wait_for(std::unique_lock<std::mutex> &locker,
+                  const std::chrono::duration<Rep, Period> &timeout, Predicate pred) {
+        return _cond.wait_for(locker, timeout, pred);
+    }
+
+    void notify_one() {
+        _cond.notify_one();
+    }
+
+    void notify_all() {
+        notify_alls++;
+        _cond.notify_all();
+    }
+private:
+    std::condition_variable _cond;
+};
+
+std::atomic<int> CountingCondition::notify_alls(0);
+
+TEST(SimpleBlockingQueueTest, Test_Linger) {
+    SimpleBlockingQueue<int, std::deque, CountingCondition> queue;
+    std::vector<int> batch;
+    std::thread lingerer([&queue, &batch]() {
+        queue.PopFrontBatchWithLinger(&batch, 8, 10000);
+    });
+    //Give the lingerer time to park
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    //Single pushes below the threshold wake nobody but plain consumers
+    CountingCondition::notify_alls = 0;
+    for (int i = 0; i < 7; i++) {
+        queue.PushBack(i);
+    }
+    ASSERT_EQ(0, CountingCondition::notify_alls.load());
+    ASSERT_EQ(7, queue.Size());
+
+    //A plain consumer is still served while the lingerer waits
+    int t = -1;
+    ASSERT_TRUE(queue.PopFrontWithTimeout(&t, 1000));
+    ASSERT_EQ(0, t);
+    queue.PushBack(7);
+    queue.PushBack(8);
+    lingerer.join();
+    ASSERT_EQ(std::vector<int>({1, 2, 3, 4, 5, 6, 7, 8}), batch);
+
+    //Without enough items the lingerer times out with what is there
+    queue.PushBack(9);
+    batch.clear();
+    ASSERT_EQ(1, queue.PopFrontBatchWithLinger(&batch, 8, 10));
+    ASSERT_EQ(std::vector<int>({9}), batch);
+    ASSERT_EQ(0, queue.PopFrontBatchWithLinger(&batch, 8, 10));
+}
+
+TEST(SpinFutexConditionTest, Test_Notify) {
+    //Each waiter takes one token
+    std::mutex mutex;
+    SpinFutexCondition cond;
+    int tokens = 0;
+    std::atomic<int> woken(0);
+    std::vector<std::thread> waiters;
+    for (int i = 0; i < 3; i++) {
+        waiters.emplace_back([&]() {
+            std::unique_lock<std::mutex> locker(mutex);
+            cond.wait(locker, [&tokens]() { return tokens > 0; });
+            --tokens;
+            woken++;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(0, woken.load());
+
+    {
+        std::lock_guard<std::mutex> locker(mutex);
+        tokens = 1;
+        cond.notify_one();
+    }
+    while (woken.load() < 1) {
+        std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(1, woken.load());
+
+    {
+        std::lock_guard<std::mutex> locker(mutex);
+        tokens = 2;
+        cond.notify_all();
+    }
+    for (auto &waiter : waiters) {
+        waiter.join();
+    }
+    ASSERT_EQ(3, woken.load());
+    ASSERT_EQ(0, tokens);
+}
+
+TEST(SpinFutexConditionTest, Test_Wait_For) {
+    std::mutex mutex;
+    SpinFutexCondition cond;
+    bool ready = false;
+    std::unique_lock<std::mutex> locker(mutex);
+    auto begin = std::chrono::steady_clock::now();
+    ASSERT_FALSE(cond.wait_for(locker, std::chrono::milliseconds(20), [&ready]() { return ready; }));
+    ASSERT_GE(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(20));
+    ASSERT_TRUE(locker.owns_lock());
+
+    std::thread notifier([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::lock_guard<std::mutex> guard(mutex);
+        ready = true;
+        cond.notify_one();
+    });
+    ASSERT_TRUE(cond.wait_for(locker, std::chrono::seconds(10), [&ready]() { return ready; }));
+    locker.unlock();
+    notifier.join();
+}
+
+//Documents the precondition of SpinFutexCondition: the state change and the
+//notify happen under the mutex the waiter holds while checking its predicate.
+//The waiter count lives under that mutex, so this ping-pong loses a wakeup
+//(and hangs) if the accounting ever drops one.
+TEST(SpinFutexConditionTest, Test_Notify_Under_Lock) {
+    std::mutex mutex;
+    SpinFutexCondition ping;
+    SpinFutexCondition pong;
+    int turn = 0;
+    const int rounds = 20000;
+    std::thread other([&]() {
+        for (int i = 0; i < rounds; i++) {
+            std::unique_lock<std::mutex> locker(mutex);
+            ping.wait(locker, [&turn]() { return turn == 1; });
+            turn = 0;
+            pong.notify_one();
+        }
+    });
+    for (int i = 0; i < rounds; i++) {
+        std::unique_lock<std::mutex> locker(mutex);
+        turn = 1;
+        ping.notify_one();
+        pong.wait(locker, [&turn]() { return turn == 0; });
+    }
+    other.join();
+}
+
+TEST(SpinFutexConditionTest, Test_Queue_Cond) {
+    SimpleBlockingQueue<int, std::deque, SpinFutexCondition> queue(4);
+    int t = 0;
+    ASSERT_FALSE(queue.PopFrontWithTimeout(&t, 10));
+    for (int i = 0; i < 4; i++) {
+        queue.PushBack(i);
+    }
+    ASSERT_FALSE(queue.PushBackWithTimeout(4, 10));
+    queue.Clear();
+
+    //Every item arrives exactly once through a small bound
+    const int producers = 3;
+    const int per_producer = 20000;
+    std::vector<std::atomic<int>> seen(producers * per_producer);
+    for (auto &s : seen) {
+        s = 0;
+    }
+    std::vector<std::thread> threads;
+    for (int c = 0; c < 3; c++) {
+        threads.emplace_back([&queue, &seen]() {
+            while (true) {
+                int v = queue.PopFront();
+                if (v < 0) {
+                    break;
+                }
+                seen[v]++;
+            }
+        });
+    }
+    std::vector<std::thread> pushers;
+    for (int p = 0; p < producers; p++) {
+        pushers.emplace_back([&queue, p, per_producer]() {
+            for (int i = 0; i < per_producer; i++) {
+                queue.PushBack(p * per_producer + i);
+            }
+        });
+    }
+    for (auto &pusher : pushers) {
+        pusher.join();
+    }
+    for (size_t c = 0; c < threads.size(); c++) {
+        queue.PushBack(-1);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < seen.size(); i++) {
+        ASSERT_EQ(1, seen[i].load());
+    }
+}
+
+//Adds up the items a queue reports through its notifier hook
+static void CountItems(void *count, int n) {
+    *static_cast<int *>(count) += n;
+}
+
+TEST(SimpleBlockingQueueTest, Test_Notifier) {
+    SimpleBlockingQueue<int> queue;
+    int count = 0;
+    queue.SetNotifier(&count, &CountItems);
+    queue.PushBack(1);
+    std::vector<int> batch{2, 3, 4};
+    queue.PushBackBatch(batch.begin(), batch.end());
+    ASSERT_EQ(4, count);
+
+    //Detaching clears the hook, whichever half is null
+    queue.SetNotifier(nullptr, &CountItems);
+    queue.PushBack(5);
+    queue.SetNotifier(&count, nullptr);
+    queue.PushBack(6);
+    ASSERT_EQ(4, count);
+    ASSERT_EQ(6u, queue.Size());
+}
+
+TEST(QueueSelectorTest, Test_Wake_From_Either) {
+    SimpleBlockingQueue<int> first;
+    SimpleBlockingQueue<int> second;
+    {
+        QueueSelector<int> selector;
+        ASSERT_EQ(0u, selector.Add(&first));
+        ASSERT_EQ(1u, selector.Add(&second));
+        int t = -1;
+        size_t index = 0;
+        ASSERT_FALSE(selector.TryPopFront(&t));
+        ASSERT_FALSE(selector.PopFrontWithTimeout(&t, 10));
+
+        //A blocked selector wakes for a push to either queue
+        for (int round = 0; round < 4; round++) {
+            SimpleBlockingQueue<int> *queue = round % 2 == 0 ? &second : &first;
+            std::thread pusher([queue, round]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                queue->PushBack(round);
+            });
+            index = selector.PopFront(&t);
+            pusher.join();
+            ASSERT_EQ(round, t);
+            ASSERT_EQ(round % 2 == 0 ? 1u : 0u, index);
+        }
+
+        //Round robin resumes after the queue served last
+        first.PushBack(10);
+        first.PushBack(11);
+        second.PushBack(20);
+        ASSERT_TRUE(selector.PopFrontWithTimeout(&t, 10, &index));
+        ASSERT_EQ(1u, index);
+        ASSERT_EQ(20, t);
+        ASSERT_EQ(0u, selector.PopFront(&t));
+        ASSERT_EQ(10, t);
+        ASSERT_EQ(0u, selector.PopFront(&t));
+        ASSERT_EQ(11, t);
+        ASSERT_TRUE(first.Empty());
+        ASSERT_TRUE(second.Empty());
+    }
+
+    //Detached by the destructor, pushes no longer touch the selector
+    first.PushBack(1);
+    second.PushBack(2);
+    ASSERT_EQ(1u, first.Size());
+    ASSERT_EQ(1u, second.Size());
+}
+
+TEST(QueueSelectorTest, Test_Priority) {
+    SimpleBlockingQueue<int> high;
+    SimpleBlockingQueue<int> low;
+    QueueSelector<int> selector(QueueSelector<int>::kPriority);
+    selector.Add(&high);
+    selector.Add(&low);
+    low.PushBack(1);
+    low.PushBack(2);
+    high.PushBack(3);
+    int t = -1;
+    ASSERT_EQ(0u, selector.PopFront(&t));
+    ASSERT_EQ(3, t);
+    ASSERT_EQ(1u, selector.PopFront(&t));
+    ASSERT_EQ(1, t);
+    high.PushBack(4);
+    ASSERT_EQ(0u, selector.PopFront(&t));
+    ASSERT_EQ(4, t);
+    ASSERT_EQ(1u, selector.PopFront(&t));
+    ASSERT_EQ(2, t);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    // Runs all tests using Google Test.
+    return RUN_ALL_TESTS();
+}
@@ -1,10 +1,19 @@
 #ifndef SIMPLELIB_LOCK_FREE_QUEUE_HPP_
 #define SIMPLELIB_LOCK_FREE_QUEUE_HPP_
 
+#include <new>
 #include <atomic>
+#include <chrono>
 #include <thread>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include <type_traits>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "common.h"
+#include "futex.hpp"
 
 #define SLFQ_UNLIKELY(x) __builtin_expect(!!(x), 0)
 
@@ -12,6 +21,8 @@ BEGIN_NAMESPACE_SIMPLELIB
 
 // This is a trade-off between space and execution time
 // We use more space to avoid false sharing between producers
+// flag is the first index of the lap the slot is free for, or its complement
+// once that lap's item is in, so an all-zero slot is free for the first lap
 template<typename T>
 struct SimpleLockFreeQueueElement {
   alignas(64) std::atomic<int64_t> flag;
@@ -20,26 +31,277 @@ struct SimpleLockFreeQueueElement {
 
 constexpr uint32_t kSimpleLockFreeQueueDefaultSize = 16384; // 16k
 
+// SIZE for a queue whose capacity is chosen at construction, see SimpleLockFreeQueueOptions
+constexpr uint32_t kSimpleLockFreeQueueRuntimeSize = 0;
+
+// Construction options of a runtime-sized queue
+struct SimpleLockFreeQueueOptions {
+  // Rounded up to a power of 2, at most 2^31
+  uint32_t capacity = kSimpleLockFreeQueueDefaultSize;
+  // Try MAP_HUGETLB first, fall back to madvise(MADV_HUGEPAGE) on normal pages
+  bool huge_pages = false;
+  // Bind the ring to this NUMA node, -1 keeps the default policy. Best effort.
+  int numa_node = -1;
+  // Fault every page in at construction instead of on first use
+  bool prefault = false;
+};
+
+// Ring storage, inline array of SIZE elements
+template<typename ELEM, uint32_t SIZE>
+class SimpleLockFreeQueueRing {
+ public:
+  SimpleLockFreeQueueRing() = default;
+
+  ELEM& operator[](int64_t idx) {
+    return elems_[idx & (SIZE - 1)];
+  }
+
+  constexpr static uint32_t Capacity() {
+    return SIZE;
+  }
+
+ private:
+  static_assert(SIZE && !(SIZE & (SIZE - 1)), "SIZE must be a power of 2");
+  ELEM elems_[SIZE];
+};
+
+// Ring storage sized at runtime and mapped with mmap, so big rings can use huge
+// pages and be placed on a NUMA node. Throws std::bad_alloc if mmap fails and
+// std::invalid_argument for a capacity above 2^31.
+//
+// ELEM is default-initialized in place, so for trivial ELEM nothing is written
+// and the zero-filled pages are faulted in on first use unless prefault is set.
+template<typename ELEM>
+class SimpleLockFreeQueueRing<ELEM, kSimpleLockFreeQueueRuntimeSize> {
+ public:
+  explicit SimpleLockFreeQueueRing(const SimpleLockFreeQueueOptions& options) {
+    static_assert(alignof(ELEM) <= 4096, "ELEM alignment exceeds a page");
+    if (options.capacity > (1U << 31)) {
+      throw std::invalid_argument("SimpleLockFreeQueue capacity above 2^31");
+    }
+    capacity_ = 1;
+    while (capacity_ < options.capacity) {
+      capacity_ <<= 1;
+    }
+    round_ = capacity_ - 1;
+
+    const size_t kHugePageSize = 2 << 20;
+    size_t bytes = sizeof(ELEM) * capacity_;
+    void* addr = MAP_FAILED;
+    if (options.huge_pages) {
+      // Needs reserved hugetlbfs pages, commonly absent
+      bytes_ = (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+      addr = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (addr == MAP_FAILED) {
+      size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+      bytes_ = (bytes + page - 1) & ~(page - 1);
+      addr = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (addr == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      if (options.huge_pages) {
+        // Transparent huge pages, ignored where THP is disabled
+        madvise(addr, bytes_, MADV_HUGEPAGE);
+      }
+    }
+    if (options.numa_node >= 0) {
+      // mbind(MPOL_BIND) before any page is touched; no libnuma dependency
+      const int kMpolBind = 2;
+      unsigned long nodemask[4] = {0};
+      if (options.numa_node < static_cast<int>(sizeof(nodemask) * 8)) {
+        nodemask[options.numa_node / 64] = 1UL << (options.numa_node % 64);
+        syscall(SYS_mbind, addr, bytes_, kMpolBind, nodemask, sizeof(nodemask) * 8, 0);
+      }
+    }
+    if (options.prefault) {
+      memset(addr, 0, bytes_);
+    }
+    elems_ = static_cast<ELEM*>(addr);
+    for (uint32_t i = 0; i < capacity_; i++) {
+      new(&elems_[i]) ELEM;
+    }
+  }
+
+  ~SimpleLockFreeQueueRing() {
+    munmap(elems_, bytes_);
+  }
+
+  SimpleLockFreeQueueRing(const SimpleLockFreeQueueRing&) = delete;
+  SimpleLockFreeQueueRing& operator=(const SimpleLockFreeQueueRing&) = delete;
+
+  ELEM& operator[](int64_t idx) {
+    return elems_[idx & round_];
+  }
+
+  uint32_t Capacity() const {
+    return capacity_;
+  }
+
+ private:
+  ELEM* elems_;
+  size_t bytes_;
+  uint32_t capacity_;
+  uint32_t round_;
+};
+
+// Concurrency mode policies
+// Any number of producers and consumers (default)
+struct SimpleLockFreeQueueMpmc {};
+// Exactly one producer thread and one consumer thread
+struct SimpleLockFreeQueueSpsc {};
+
+// Wait strategy policies, as in the Disruptor. They decide what a thread does
+// while its slot is still busy (Idle) and while PushWait/PopWait find the queue
+// full/empty (PrepareWait, then Wait or CancelWait). Notify is called after
+// every successful Push/Pop, NotifyAll from Invalid().
+//
+// Spin on the pause instruction: lowest latency, but every waiter needs a core
+// of its own or it starves the thread it waits for
+struct SimpleLockFreeQueueBusySpinWait {
+  static void Idle(uint32_t) {
+    Pause();
+  }
+
+  static void Pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  uint32_t PrepareWait() { return 0; }
+  void CancelWait() {}
+  void Wait(uint32_t, uint32_t round) { Idle(round); }
+  void Notify() {}
+  void NotifyAll() {}
+};
+
+// Pause 1, 2, 4 ... 64 times, then yield on every further round
+struct SimpleLockFreeQueueBackoffWait {
+  static void Idle(uint32_t round) {
+    if (round < kSpinRounds) {
+      for (uint32_t i = 0; i < (1U << round); i++) {
+        SimpleLockFreeQueueBusySpinWait::Pause();
+      }
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  uint32_t PrepareWait() { return 0; }
+  void CancelWait() {}
+  void Wait(uint32_t, uint32_t round) { Idle(round); }
+  void Notify() {}
+  void NotifyAll() {}
+
+ private:
+  constexpr static uint32_t kSpinRounds = 7;
+};
+
+// Yield the CPU on every round (default)
+struct SimpleLockFreeQueueYieldWait {
+  static void Idle(uint32_t) {
+    std::this_thread::yield();
+  }
+
+  uint32_t PrepareWait() { return 0; }
+  void CancelWait() {}
+  void Wait(uint32_t, uint32_t round) { Idle(round); }
+  void Notify() {}
+  void NotifyAll() {}
+};
+
+// Yield for a few rounds, then sleep: little CPU, wake-up latency is the sleep
+// granularity plus timer slack
+struct SimpleLockFreeQueueSleepWait {
+  static void Idle(uint32_t round) {
+    if (round < kYieldRounds) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(kSleepMicros)));
+    }
+  }
+
+  uint32_t PrepareWait() { return 0; }
+  void CancelWait() {}
+  void Wait(uint32_t, uint32_t round) { Idle(round); }
+  void Notify() {}
+  void NotifyAll() {}
+
+ private:
+  constexpr static uint32_t kYieldRounds = 16;
+  constexpr static int kSleepMicros = 100;
+};
+
+// Park PushWait/PopWait callers on a futex. Costs a fence per Push/Pop so the
+// notifier sees a waiter that missed its update; the futex syscall is only made
+// when somebody is parked. Slot waits are short and just yield.
+class SimpleLockFreeQueueBlockingWait {
+ public:
+  static void Idle(uint32_t) {
+    std::this_thread::yield();
+  }
+
+  uint32_t PrepareWait() {
+    uint32_t key = event_.PrepareWait();
+    // Orders the waiter count before the retry's index loads, pairs with Notify
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return key;
+  }
+
+  void CancelWait() {
+    event_.CancelWait();
+  }
+
+  void Wait(uint32_t key, uint32_t) {
+    event_.Wait(key);
+  }
+
+  void Notify() {
+    // Orders the queue update before the waiter count load, pairs with PrepareWait
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    event_.Notify();
+  }
+
+  void NotifyAll() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    event_.NotifyAll();
+  }
+
+ private:
+  EventCount event_;
+};
+
 // A "cheap" version disruptor:
 // 1. Ring buffer
 // 2. Using CAS instead of mutex
 // 3. Alignment to 64 bytes to avoiding cache line false sharing
 // 4. Force size to be power of 2 to speed up element locating
+// 5. SIZE = kSimpleLockFreeQueueRuntimeSize takes the capacity from
+//    SimpleLockFreeQueueOptions at construction and maps the ring with mmap
 //
 // Hits:
 // When you want to stop, you MUST call Invalid() to save your threads from infinite looping in Push/Pop/Emplace
-template<typename T, uint32_t SIZE = kSimpleLockFreeQueueDefaultSize>
+// and to release the ones blocked in PushWait/PopWait
+template<typename T,
+    uint32_t SIZE = kSimpleLockFreeQueueDefaultSize,
+    typename MODE = SimpleLockFreeQueueMpmc,
+    typename WAIT = SimpleLockFreeQueueYieldWait>
 class SimpleLockFreeQueue
 {
  public:
   SimpleLockFreeQueue() {
-    for(uint32_t i = 0; i < SIZE; i++) {
-      ring_buffer_[i].flag.store(i, std::memory_order_relaxed);
-    }
+    Init();
   }
 
+  // Runtime-sized queues only (SIZE == kSimpleLockFreeQueueRuntimeSize). The
+  // mapped ring starts zero-filled, which is every flag's initial value, so
+  // construction does not touch its pages.
+  explicit SimpleLockFreeQueue(const SimpleLockFreeQueueOptions& options) : ring_buffer_(options) {}
+
   ~SimpleLockFreeQueue() {
-    for(uint32_t i = 0; i < SIZE; i++) {
+    for(uint32_t i = 0; i < ring_buffer_.Capacity(); i++) {
       if(ring_buffer_[i].flag.load(std::memory_order_relaxed) < 0) {
         reinterpret_cast<T&>(ring_buffer_[i].data).~T();
       }
@@ -57,15 +319,17 @@ class SimpleLockFreeQueue
     }
 
     int64_t current_idx = write_idx_.fetch_add(1, std::memory_order_relaxed);
-    auto& elem = ring_buffer_[current_idx & round_];
-    while (elem.flag.load(std::memory_order_acquire) != current_idx) {
+    int64_t lap = Lap(current_idx);
+    auto& elem = ring_buffer_[current_idx];
+    for (uint32_t round = 0; elem.flag.load(std::memory_order_acquire) != lap; round++) {
       if (SLFQ_UNLIKELY(!IsValid())) {
         return false;
       }
-      std::this_thread::yield();
+      WAIT::Idle(round);
     }
     new(&elem.data) T(std::forward<Args>(args)...);
-    elem.flag.store(~current_idx, std::memory_order_release);
+    elem.flag.store(~lap, std::memory_order_release);
+    not_empty_.Notify();
 
     return true;
   }
@@ -74,6 +338,30 @@ class SimpleLockFreeQueue
     return Emplace(t);
   }
 
+  // Like Emplace, but waits while the queue is full. Returns false only once invalidated.
+  template<typename... Args>
+  bool EmplaceWait(Args&&... args) {
+    if (Emplace(std::forward<Args>(args)...)) {
+      return true;
+    }
+    for (uint32_t round = 0; ; round++) {
+      uint32_t key = not_full_.PrepareWait();
+      if (Emplace(std::forward<Args>(args)...)) {
+        not_full_.CancelWait();
+        return true;
+      }
+      if (SLFQ_UNLIKELY(!IsValid())) {
+        not_full_.CancelWait();
+        return false;
+      }
+      not_full_.Wait(key, round);
+    }
+  }
+
+  bool PushWait(const T& t) {
+    return EmplaceWait(t);
+  }
+
   bool Pop(T* t) {
     if (SLFQ_UNLIKELY(!IsValid())) {
       return false;
@@ -84,22 +372,47 @@ class SimpleLockFreeQueue
     }
 
     int64_t current_idx = read_idx_.fetch_add(1, std::memory_order_relaxed);
-    auto& elem = ring_buffer_[current_idx & round_];
-    while (elem.flag.load(std::memory_order_acquire) != ~current_idx) {
+    int64_t lap = Lap(current_idx);
+    auto& elem = ring_buffer_[current_idx];
+    for (uint32_t round = 0; elem.flag.load(std::memory_order_acquire) != ~lap; round++) {
       if (SLFQ_UNLIKELY(!IsValid())) {
         return false;
       }
-      std::this_thread::yield();
+      WAIT::Idle(round);
     }
-    *t = std::move(*reinterpret_cast<const T*>(&elem.data));
-    elem.flag.store(current_idx + SIZE, std::memory_order_release);
+    T& value = reinterpret_cast<T&>(elem.data);
+    *t = std::move(value);
+    value.~T();
+    elem.flag.store(lap + ring_buffer_.Capacity(), std::memory_order_release);
+    not_full_.Notify();
 
     return true;
   }
 
+  // Like Pop, but waits while the queue is empty. Returns false only once invalidated.
+  bool PopWait(T* t) {
+    if (Pop(t)) {
+      return true;
+    }
+    for (uint32_t round = 0; ; round++) {
+      uint32_t key = not_empty_.PrepareWait();
+      if (Pop(t)) {
+        not_empty_.CancelWait();
+        return true;
+      }
+      if (SLFQ_UNLIKELY(!IsValid())) {
+        not_empty_.CancelWait();
+        return false;
+      }
+      not_empty_.Wait(key, round);
+    }
+  }
+
   // You MUST call Invalid to save your threads from infinite looping in Push/Pop/Emplace
   void Invalid() {
-    return valid_.store(false,std::memory_order_relaxed);
+    valid_.store(false,std::memory_order_relaxed);
+    not_empty_.NotifyAll();
+    not_full_.NotifyAll();
   }
 
   int64_t Size() {
@@ -111,7 +424,7 @@ class SimpleLockFreeQueue
   }
 
   bool IsFull() {
-      return Size() >= SIZE;
+      return Size() >= ring_buffer_.Capacity();
   }
 
   bool IsValid() {
@@ -119,9 +432,16 @@ class SimpleLockFreeQueue
   }
 
  private:
-  // Compile time constants
-  static_assert(SIZE && !(SIZE & (SIZE - 1)), "SIZE must be a power of 2");
-  constexpr static uint32_t round_ = SIZE - 1;
+  void Init() {
+    for(uint32_t i = 0; i < ring_buffer_.Capacity(); i++) {
+      ring_buffer_[i].flag.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // First index of the lap around the ring that idx belongs to
+  int64_t Lap(int64_t idx) {
+    return idx & -static_cast<int64_t>(ring_buffer_.Capacity());
+  }
 
   // Indexes
   alignas(64) std::atomic<int64_t> write_idx_{0};
@@ -130,8 +450,175 @@ class SimpleLockFreeQueue
   // Stop flag
   std::atomic<bool> valid_{true};
 
+  // Waiters of PopWait/PushWait
+  WAIT not_empty_;
+  WAIT not_full_;
+
+  // Ring buffer
+  SimpleLockFreeQueueRing<SimpleLockFreeQueueElement<T>, SIZE> ring_buffer_;
+};
+
+// Single-producer/single-consumer mode:
+// 1. Each index has one writer, so plain acquire/release loads and stores
+//    replace fetch_add
+// 2. Each side caches the other side's index and only reloads it when the
+//    ring looks full/empty, so the shared cache lines are rarely touched
+// 3. No per-slot flags, elements are packed back to back
+template<typename T, uint32_t SIZE, typename WAIT>
+class SimpleLockFreeQueue<T, SIZE, SimpleLockFreeQueueSpsc, WAIT>
+{
+ public:
+  SimpleLockFreeQueue() = default;
+
+  // Runtime-sized queues only (SIZE == kSimpleLockFreeQueueRuntimeSize)
+  explicit SimpleLockFreeQueue(const SimpleLockFreeQueueOptions& options) : ring_buffer_(options) {}
+
+  ~SimpleLockFreeQueue() {
+    int64_t write_idx = write_idx_.load(std::memory_order_relaxed);
+    for (int64_t i = read_idx_.load(std::memory_order_relaxed); i < write_idx; i++) {
+      Slot(i)->~T();
+    }
+  }
+
+  // Producer only
+  template<typename... Args>
+  bool Emplace(Args&&... args) {
+    if (SLFQ_UNLIKELY(!IsValid())) {
+      return false;
+    }
+
+    int64_t current_idx = write_idx_.load(std::memory_order_relaxed);
+    if (current_idx - cached_read_idx_ >= ring_buffer_.Capacity()) {
+      cached_read_idx_ = read_idx_.load(std::memory_order_acquire);
+      if (current_idx - cached_read_idx_ >= ring_buffer_.Capacity()) {
+        return false;
+      }
+    }
+    new(Slot(current_idx)) T(std::forward<Args>(args)...);
+    write_idx_.store(current_idx + 1, std::memory_order_release);
+    not_empty_.Notify();
+
+    return true;
+  }
+
+  bool Push(const T& t) {
+    return Emplace(t);
+  }
+
+  // Producer only. Like Emplace, but waits while the queue is full. Returns
+  // false only once invalidated.
+  template<typename... Args>
+  bool EmplaceWait(Args&&... args) {
+    if (Emplace(std::forward<Args>(args)...)) {
+      return true;
+    }
+    for (uint32_t round = 0; ; round++) {
+      uint32_t key = not_full_.PrepareWait();
+      if (Emplace(std::forward<Args>(args)...)) {
+        not_full_.CancelWait();
+        return true;
+      }
+      if (SLFQ_UNLIKELY(!IsValid())) {
+        not_full_.CancelWait();
+        return false;
+      }
+      not_full_.Wait(key, round);
+    }
+  }
+
+  bool PushWait(const T& t) {
+    return EmplaceWait(t);
+  }
+
+  // Consumer only
+  bool Pop(T* t) {
+    if (SLFQ_UNLIKELY(!IsValid())) {
+      return false;
+    }
+
+    int64_t current_idx = read_idx_.load(std::memory_order_relaxed);
+    if (current_idx >= cached_write_idx_) {
+      cached_write_idx_ = write_idx_.load(std::memory_order_acquire);
+      if (current_idx >= cached_write_idx_) {
+        return false;
+      }
+    }
+    T* elem = Slot(current_idx);
+    *t = std::move(*elem);
+    elem->~T();
+    read_idx_.store(current_idx + 1, std::memory_order_release);
+    not_full_.Notify();
+
+    return true;
+  }
+
+  // Consumer only. Like Pop, but waits while the queue is empty. Returns false
+  // only once invalidated.
+  bool PopWait(T* t) {
+    if (Pop(t)) {
+      return true;
+    }
+    for (uint32_t round = 0; ; round++) {
+      uint32_t key = not_empty_.PrepareWait();
+      if (Pop(t)) {
+        not_empty_.CancelWait();
+        return true;
+      }
+      if (SLFQ_UNLIKELY(!IsValid())) {
+        not_empty_.CancelWait();
+        return false;
+      }
+      not_empty_.Wait(key, round);
+    }
+  }
+
+  // Push/Pop fail once invalidated, PushWait/PopWait return
+  void Invalid() {
+    valid_.store(false,std::memory_order_relaxed);
+    not_empty_.NotifyAll();
+    not_full_.NotifyAll();
+  }
+
+  int64_t Size() {
+    return write_idx_.load(std::memory_order_relaxed) - read_idx_.load(std::memory_order_relaxed);
+  }
+
+  bool IsEmpty() {
+      return Size() <= 0;
+  }
+
+  bool IsFull() {
+      return Size() >= ring_buffer_.Capacity();
+  }
+
+  bool IsValid() {
+    return valid_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+
+  T* Slot(int64_t idx) {
+    return reinterpret_cast<T*>(&ring_buffer_[idx]);
+  }
+
+  // Producer side: its index and its copy of the consumer's
+  alignas(64) std::atomic<int64_t> write_idx_{0};
+  int64_t cached_read_idx_{0};
+
+  // Consumer side: its index and its copy of the producer's
+  alignas(64) std::atomic<int64_t> read_idx_{0};
+  int64_t cached_write_idx_{0};
+
+  // Stop flag
+  alignas(64) std::atomic<bool> valid_{true};
+
+  // Waiters of PopWait/PushWait
+  WAIT not_empty_;
+  WAIT not_full_;
+
   // Ring buffer
-  SimpleLockFreeQueueElement<T> ring_buffer_[SIZE];
+  alignas(64) SimpleLockFreeQueueRing<Storage, SIZE> ring_buffer_;
 };
 
 END_NAMESPACE_SIMPLELIB
@@ -0,0 +1,192 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <time.h>
+#include "simple_lock_free_queue.hpp"
+
+using namespace simplelib;
+
+//Run func once and return the elapsed wall time in milliseconds
+template <typename Func>
+double time_ms(Func func) {
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+//Nanoseconds on the steady clock, used to stamp items
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//CPU time consumed by the calling thread in milliseconds
+double thread_cpu_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+//One producer, one consumer, both retrying with yield when the ring is full/empty
+template <typename Queue>
+void run_throughput(const char *name, Queue *queue, size_t n) {
+    long sum = 0;
+    double elapsed = time_ms([&]() {
+        std::thread consumer([&]() {
+            long v;
+            for (size_t i = 0; i < n; i++) {
+                while (!queue->Pop(&v)) {
+                    std::this_thread::yield();
+                }
+                sum += v;
+            }
+        });
+        for (size_t i = 0; i < n; i++) {
+            while (!queue->Push(static_cast<long>(i))) {
+                std::this_thread::yield();
+            }
+        }
+        consumer.join();
+    });
+    printf("%-6s throughput %7.2f Mops/s%s\n", name, n / 1000.0 / elapsed,
+           sum != static_cast<long>(n * (n - 1) / 2) ? " !" : "");
+}
+
+template <typename Queue>
+void bench_throughput(const char *name, size_t n) {
+    //Over 1 MiB and over-aligned, which C++14 new does not honor
+    static Queue storage;
+    run_throughput(name, &storage, n);
+}
+
+//Same run on a ring sized at construction and mapped with mmap
+template <typename Queue>
+void bench_runtime(const char *name, size_t n, uint32_t capacity, bool huge_pages) {
+    SimpleLockFreeQueueOptions options;
+    options.capacity = capacity;
+    options.huge_pages = huge_pages;
+    options.prefault = true;
+    Queue queue(options);
+    run_throughput(name, &queue, n);
+}
+
+//Stamped items in bursts of 16 with 100 us gaps, push-to-pop latency percentiles
+template <typename Queue>
+void bench_latency(const char *name, int bursts) {
+    static Queue storage;
+    Queue *queue = &storage;
+    size_t total = static_cast<size_t>(bursts) * 16;
+    std::vector<int64_t> latencies;
+    latencies.reserve(total);
+    std::thread consumer([&]() {
+        int64_t stamp;
+        while (latencies.size() < total) {
+            if (queue->Pop(&stamp)) {
+                latencies.push_back(now_ns() - stamp);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    for (int b = 0; b < bursts; b++) {
+        for (int i = 0; i < 16; i++) {
+            while (!queue->Push(now_ns())) {
+                std::this_thread::yield();
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    consumer.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))] / 1000.0;
+    };
+    printf("%-6s latency p50 %8.2f us  p99 %8.2f us  p99.9 %8.2f us\n",
+           name, pct(0.5), pct(0.99), pct(0.999));
+}
+
+//Like bench_latency with PushWait/PopWait, also reports the CPU time the
+//consumer burns while the queue is mostly empty
+template <typename Queue>
+void bench_wait(const char *name, int bursts) {
+    static Queue storage;
+    Queue *queue = &storage;
+    size_t total = static_cast<size_t>(bursts) * 16;
+    std::vector<int64_t> latencies;
+    latencies.reserve(total);
+    double cpu = 0;
+    std::thread consumer([&]() {
+        double begin = thread_cpu_ms();
+        int64_t stamp;
+        while (latencies.size() < total && queue->PopWait(&stamp)) {
+            latencies.push_back(now_ns() - stamp);
+        }
+        cpu = thread_cpu_ms() - begin;
+    });
+    double elapsed = time_ms([&]() {
+        for (int b = 0; b < bursts; b++) {
+            for (int i = 0; i < 16; i++) {
+                queue->PushWait(now_ns());
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        consumer.join();
+    });
+
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))] / 1000.0;
+    };
+    printf("%-8s p50 %8.2f us  p99 %8.2f us  consumer cpu %5.1f%%\n",
+           name, pct(0.5), pct(0.99), 100.0 * cpu / elapsed);
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+
+    printf("== 1P/1C, %zu items, %u hardware threads ==\n", n, std::thread::hardware_concurrency());
+    bench_throughput<SimpleLockFreeQueue<long>>("mpmc", n);
+    bench_throughput<SimpleLockFreeQueue<long, kSimpleLockFreeQueueDefaultSize,
+                                         SimpleLockFreeQueueSpsc>>("spsc", n);
+
+    printf("== 1P/1C, runtime-sized ring, %u slots ==\n", kSimpleLockFreeQueueDefaultSize);
+    bench_runtime<SimpleLockFreeQueue<long, kSimpleLockFreeQueueRuntimeSize>>(
+        "mpmc", n, kSimpleLockFreeQueueDefaultSize, false);
+    bench_runtime<SimpleLockFreeQueue<long, kSimpleLockFreeQueueRuntimeSize,
+                                      SimpleLockFreeQueueSpsc>>(
+        "spsc", n, kSimpleLockFreeQueueDefaultSize, false);
+
+    //16 MiB of mpmc slots, far past the TLB reach of 4 KiB pages
+    printf("== 1P/1C, runtime-sized ring, 256k slots, 4k vs huge pages ==\n");
+    bench_runtime<SimpleLockFreeQueue<long, kSimpleLockFreeQueueRuntimeSize>>(
+        "4k", n, 1 << 18, false);
+    bench_runtime<SimpleLockFreeQueue<long, kSimpleLockFreeQueueRuntimeSize>>(
+        "huge", n, 1 << 18, true);
+
+    printf("== 1P/1C bursty latency, 2000 bursts of 16 ==\n");
+    bench_latency<SimpleLockFreeQueue<int64_t>>("mpmc", 2000);
+    bench_latency<SimpleLockFreeQueue<int64_t, kSimpleLockFreeQueueDefaultSize,
+                                      SimpleLockFreeQueueSpsc>>("spsc", 2000);
+
+    printf("== 1P/1C bursty PushWait/PopWait by wait strategy, 2000 bursts of 16 ==\n");
+    if (std::thread::hardware_concurrency() > 1) {
+        bench_wait<SimpleLockFreeQueue<int64_t, kSimpleLockFreeQueueDefaultSize, SimpleLockFreeQueueMpmc,
+                                       SimpleLockFreeQueueBusySpinWait>>("spin", 2000);
+    }
+    bench_wait<SimpleLockFreeQueue<int64_t, kSimpleLockFreeQueueDefaultSize, SimpleLockFreeQueueMpmc,
+                                   SimpleLockFreeQueueBackoffWait>>("backoff", 2000);
+    bench_wait<SimpleLockFreeQueue<int64_t, kSimpleLockFreeQueueDefaultSize, SimpleLockFreeQueueMpmc,
+                                   SimpleLockFreeQueueYieldWait>>("yield", 2000);
+    bench_wait<SimpleLockFreeQueue<int64_t, kSimpleLockFreeQueueDefaultSize, SimpleLockFreeQueueMpmc,
+                                   SimpleLockFreeQueueSleepWait>>("sleep", 2000);
+    bench_wait<SimpleLockFreeQueue<int64_t, kSimpleLockFreeQueueDefaultSize, SimpleLockFreeQueueMpmc,
+                                   SimpleLockFreeQueueBlockingWait>>("blocking", 2000);
+
+    return 0;
+}
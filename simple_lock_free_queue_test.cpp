@@ -0,0 +1,272 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "simple_lock_free_queue.hpp"
+
+using namespace simplelib;
+
+//Counts live instances, so leaked or doubly destroyed items show up
+struct Counted {
+    static std::atomic<int> live;
+
+    Counted() : _v(-1) {
+        live++;
+    }
+
+    explicit Counted(int v) : _v(v) {
+        live++;
+    }
+
+    Counted(const Counted &other) : _v(other._v) {
+        live++;
+    }
+
+    Counted &operator=(const Counted &other) = default;
+
+    ~Counted() {
+        live--;
+    }
+
+    int _v;
+};
+
+std::atomic<int> Counted::live(0);
+
+template <typename QUEUE>
+void RunWrapAround(QUEUE *queue, int capacity) {
+    int t = -1;
+    ASSERT_FALSE(queue->Pop(&t));
+    int next_push = 0;
+    int next_pop = 0;
+    //Offsets the indexes a little more each round, so every slot gets to be
+    //the first and the last one
+    for (int round = 0; round < 3 * capacity; round++) {
+        while (queue->Push(next_push)) {
+            next_push++;
+        }
+        ASSERT_TRUE(queue->IsFull());
+        ASSERT_EQ(capacity, queue->Size());
+        for (int i = 0; i <= round % capacity; i++) {
+            ASSERT_TRUE(queue->Pop(&t));
+            ASSERT_EQ(next_pop++, t);
+        }
+    }
+    while (queue->Pop(&t)) {
+        ASSERT_EQ(next_pop++, t);
+    }
+    ASSERT_EQ(next_push, next_pop);
+    ASSERT_TRUE(queue->IsEmpty());
+}
+
+TEST(SimpleLockFreeQueueTest, Test_Wrap_Around) {
+    SimpleLockFreeQueue<int, 4, SimpleLockFreeQueueSpsc> spsc;
+    RunWrapAround(&spsc, 4);
+    SimpleLockFreeQueue<int, 4> mpmc;
+    RunWrapAround(&mpmc, 4);
+
+    //Runtime sizes round up to a power of 2
+    SimpleLockFreeQueueOptions options;
+    options.capacity = 5;
+    SimpleLockFreeQueue<int, kSimpleLockFreeQueueRuntimeSize, SimpleLockFreeQueueSpsc> runtime_spsc(options);
+    RunWrapAround(&runtime_spsc, 8);
+    SimpleLockFreeQueue<int, kSimpleLockFreeQueueRuntimeSize> runtime_mpmc(options);
+    RunWrapAround(&runtime_mpmc, 8);
+}
+
+TEST(SimpleLockFreeQueueTest, Test_Spsc_Order) {
+    const int n = 200000;
+    SimpleLockFreeQueue<int, 8, SimpleLockFreeQueueSpsc> queue;
+    std::thread producer([&queue, n]() {
+        for (int i = 0; i < n; i++) {
+            while (!queue.Push(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    int t = -1;
+    for (int i = 0; i < n; i++) {
+        while (!queue.Pop(&t)) {
+            std::this_thread::yield();
+        }
+        ASSERT_EQ(i, t);
+    }
+    producer.join();
+    ASSERT_TRUE(queue.IsEmpty());
+}
+
+template <typename QUEUE>
+void RunDestructor() {
+    ASSERT_EQ(0, Counted::live.load());
+    {
+        QUEUE queue;
+        Counted t;
+        //Move the indexes so the items left behind wrap around the end
+        for (int i = 0; i < 6; i++) {
+            ASSERT_TRUE(queue.Push(Counted(i)));
+            ASSERT_TRUE(queue.Pop(&t));
+            ASSERT_EQ(i, t._v);
+        }
+        ASSERT_EQ(1, Counted::live.load());
+        for (int i = 0; i < 5; i++) {
+            ASSERT_TRUE(queue.Push(Counted(i)));
+        }
+        ASSERT_TRUE(queue.Pop(&t));
+        ASSERT_EQ(0, t._v);
+        ASSERT_EQ(5, Counted::live.load());
+    }
+    ASSERT_EQ(0, Counted::live.load());
+}
+
+TEST(SimpleLockFreeQueueTest, Test_Destructor) {
+    RunDestructor<SimpleLockFreeQueue<Counted, 8, SimpleLockFreeQueueSpsc>>();
+    RunDestructor<SimpleLockFreeQueue<Counted, 8>>();
+}
+
+//Producers and consumers that only use PushWait/PopWait through a small ring
+template <typename QUEUE>
+void RunWait(int producers, int consumers) {
+    const int per_producer = 2000;
+    QUEUE queue;
+    std::vector<std::atomic<int>> seen(producers * per_producer);
+    for (auto &s : seen) {
+        s = 0;
+    }
+    std::atomic<int> popped(0);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&]() {
+            int t = -1;
+            while (queue.PopWait(&t)) {
+                seen[t]++;
+                popped++;
+            }
+        });
+    }
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p, per_producer]() {
+            for (int i = 0; i < per_producer; i++) {
+                ASSERT_TRUE(queue.PushWait(p * per_producer + i));
+            }
+        });
+    }
+    while (popped.load() < producers * per_producer) {
+        std::this_thread::yield();
+    }
+    //Releases the consumers parked on the empty queue
+    queue.Invalid();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < seen.size(); i++) {
+        ASSERT_EQ(1, seen[i].load()) << i;
+    }
+}
+
+template <typename WAIT>
+void RunWaitModes() {
+    RunWait<SimpleLockFreeQueue<int, 16, SimpleLockFreeQueueSpsc, WAIT>>(1, 1);
+    RunWait<SimpleLockFreeQueue<int, 16, SimpleLockFreeQueueMpmc, WAIT>>(2, 2);
+}
+
+TEST(SimpleLockFreeQueueTest, Test_Wait_Strategies) {
+    RunWaitModes<SimpleLockFreeQueueBusySpinWait>();
+    RunWaitModes<SimpleLockFreeQueueBackoffWait>();
+    RunWaitModes<SimpleLockFreeQueueYieldWait>();
+    RunWaitModes<SimpleLockFreeQueueSleepWait>();
+    RunWaitModes<SimpleLockFreeQueueBlockingWait>();
+}
+
+template <typename QUEUE>
+void RunInvalid() {
+    QUEUE empty;
+    std::atomic<bool> popped(true);
+    std::thread consumer([&empty, &popped]() {
+        int t = -1;
+        popped = empty.PopWait(&t);
+    });
+
+    QUEUE full;
+    while (full.Push(0)) {
+    }
+    std::atomic<bool> pushed(true);
+    std::thread producer([&full, &pushed]() {
+        pushed = full.PushWait(1);
+    });
+
+    //Both park on the futex until Invalid() wakes them
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    empty.Invalid();
+    full.Invalid();
+    consumer.join();
+    producer.join();
+    ASSERT_FALSE(popped.load());
+    ASSERT_FALSE(pushed.load());
+}
+
+TEST(SimpleLockFreeQueueTest, Test_Invalid_Releases_Waiters) {
+    RunInvalid<SimpleLockFreeQueue<int, 4, SimpleLockFreeQueueSpsc, SimpleLockFreeQueueBlockingWait>>();
+    RunInvalid<SimpleLockFreeQueue<int, 4, SimpleLockFreeQueueMpmc, SimpleLockFreeQueueBlockingWait>>();
+}
+
+static long MinorFaults() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+//Returns the page faults taken by constructing the queue
+template <typename QUEUE>
+long ConstructionFaults(bool prefault) {
+    SimpleLockFreeQueueOptions options;
+    options.capacity = 1 << 16;
+    options.prefault = prefault;
+    long before = MinorFaults();
+    QUEUE queue(options);
+    long faults = MinorFaults() - before;
+    //Starting from untouched pages still works
+    int t = -1;
+    for (int i = 0; i < (1 << 17); i++) {
+        EXPECT_TRUE(queue.Push(i));
+        EXPECT_TRUE(queue.Pop(&t));
+        EXPECT_EQ(i, t);
+    }
+    return faults;
+}
+
+template <typename QUEUE>
+void RunPrefault() {
+    //The ring spans hundreds of pages, construction only touches them on request
+    long lazy = ConstructionFaults<QUEUE>(false);
+    long eager = ConstructionFaults<QUEUE>(true);
+    ASSERT_LT(lazy, 16);
+    ASSERT_GT(eager, lazy);
+}
+
+TEST(SimpleLockFreeQueueTest, Test_Runtime_Prefault) {
+    RunPrefault<SimpleLockFreeQueue<int, kSimpleLockFreeQueueRuntimeSize>>();
+    RunPrefault<SimpleLockFreeQueue<int, kSimpleLockFreeQueueRuntimeSize, SimpleLockFreeQueueSpsc>>();
+}
+
+TEST(SimpleLockFreeQueueTest, Test_Runtime_Capacity) {
+    SimpleLockFreeQueueOptions options;
+    options.capacity = 0;
+    SimpleLockFreeQueue<int, kSimpleLockFreeQueueRuntimeSize> smallest(options);
+    ASSERT_TRUE(smallest.Push(1));
+    ASSERT_FALSE(smallest.Push(2));
+
+    //Would wrap the power of 2 round-up
+    options.capacity = (1U << 31) + 1;
+    typedef SimpleLockFreeQueue<int, kSimpleLockFreeQueueRuntimeSize> Queue;
+    ASSERT_THROW(Queue queue(options), std::invalid_argument);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    // Runs all tests using Google Test.
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,319 @@
+#ifndef SIMPLELIB_TWO_LOCK_BLOCKING_QUEUE_HPP_
+#define SIMPLELIB_TWO_LOCK_BLOCKING_QUEUE_HPP_
+
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <limits>
+#include <cstdint>
+#include <utility>
+#include <condition_variable>
+#include "common.h"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+//FIFO-only blocking queue after Michael & Scott's two-lock queue: producers take
+//tail_mutex_, consumers take head_mutex_, so a push and a pop run in parallel.
+//Items live in a linked list of fixed-size segments. Drained segments are kept
+//on a small stack for the producers to reuse, so steady state does not allocate. An atomic
+//count carries the bound and publishes items from one side to the other. Each
+//side wakes the other only on the empty/full edge and otherwise cascades
+//wakeups among its own waiters.
+template<typename T>
+class TwoLockBlockingQueue {
+ public:
+  static const size_t kSegmentSize = 64;
+  static const size_t kMaxSpares = 64;
+
+  TwoLockBlockingQueue() : head_(new Segment), tail_(head_) {}
+  explicit TwoLockBlockingQueue(std::uint32_t max_size) : TwoLockBlockingQueue() {
+    max_size_.store(max_size);
+  }
+  virtual ~TwoLockBlockingQueue() {
+    Clear();
+    delete head_;
+    while (Segment *segment = PopSpare()) {
+      delete segment;
+    }
+  }
+
+  TwoLockBlockingQueue(const TwoLockBlockingQueue &) = delete;
+  TwoLockBlockingQueue &operator=(const TwoLockBlockingQueue &) = delete;
+
+  void PushBack(const T &t) {
+    EmplaceBack(t);
+  }
+
+  void PushBack(T &&t) {
+    EmplaceBack(std::move(t));
+  }
+
+  bool PushBackWithTimeout(const T &t, int timeout/*in milliseconds*/) {
+    return EmplaceBackWithTimeout(timeout, t);
+  }
+
+  bool PushBackWithTimeout(T &&t, int timeout/*in milliseconds*/) {
+    return EmplaceBackWithTimeout(timeout, std::move(t));
+  }
+
+  //Never blocks, returns false if the queue is full
+  bool TryPushBack(const T &t) {
+    return TryEmplaceBack(t);
+  }
+
+  bool TryPushBack(T &&t) {
+    return TryEmplaceBack(std::move(t));
+  }
+
+  template<typename... Args>
+  void EmplaceBack(Args &&... args) {
+    size_t c;
+    {
+      std::unique_lock<std::mutex> locker(tail_mutex_);
+      not_full_.wait(locker, [this]() { return count_.load() < max_size_.load(); });
+      c = Enqueue(std::forward<Args>(args)...);
+    }
+    if (c == 0) {
+      SignalNotEmpty();
+    }
+  }
+
+  template<typename... Args>
+  bool EmplaceBackWithTimeout(int timeout/*in milliseconds*/, Args &&... args) {
+    size_t c;
+    {
+      std::unique_lock<std::mutex> locker(tail_mutex_);
+      if (!not_full_.wait_for(locker,
+                              std::chrono::milliseconds(timeout),
+                              [this]() { return count_.load() < max_size_.load(); })) {
+        //timeout
+        return false;
+      }
+      c = Enqueue(std::forward<Args>(args)...);
+    }
+    if (c == 0) {
+      SignalNotEmpty();
+    }
+    return true;
+  }
+
+  void PopFront(T *t) {
+    std::unique_lock<std::mutex> locker(head_mutex_);
+    not_empty_.wait(locker, [this]() { return count_.load() > 0; });
+    Segment *drained = Advance();
+    (*t) = std::move(*Front());
+    Release(&locker, drained, Dequeue());
+  }
+
+  //Blocking pop returning the value, T needs no default constructor
+  T PopFront() {
+    std::unique_lock<std::mutex> locker(head_mutex_);
+    not_empty_.wait(locker, [this]() { return count_.load() > 0; });
+    Segment *drained = Advance();
+    T t(std::move(*Front()));
+    Release(&locker, drained, Dequeue());
+    return t;
+  }
+
+  bool PopFrontWithTimeout(T *t, int timeout/*in milliseconds*/) {
+    std::unique_lock<std::mutex> locker(head_mutex_);
+    if (not_empty_.wait_for(locker,
+                            std::chrono::milliseconds(timeout),
+                            [this]() { return count_.load() > 0; })) {
+      Segment *drained = Advance();
+      (*t) = std::move(*Front());
+      Release(&locker, drained, Dequeue());
+      return true;
+    }
+    //timeout
+    return false;
+  }
+
+  //Never blocks, returns false if the queue is empty
+  bool TryPopFront(T *t) {
+    std::unique_lock<std::mutex> locker(head_mutex_);
+    if (count_.load() == 0) {
+      return false;
+    }
+    Segment *drained = Advance();
+    (*t) = std::move(*Front());
+    Release(&locker, drained, Dequeue());
+    return true;
+  }
+
+  void SetMaxSize(uint32_t max_size) {
+    max_size_.store(max_size);
+    std::lock_guard<std::mutex> locker(tail_mutex_);
+    not_full_.notify_all();
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> tail_locker(tail_mutex_);
+    std::lock_guard<std::mutex> head_locker(head_mutex_);
+    size_t c = count_.load();
+    for (size_t i = 0; i < c; ++i) {
+      delete Advance();
+      Front()->~T();
+      ++head_index_;
+    }
+    //Every item was consumed, so head_ caught up with tail_
+    head_index_ = 0;
+    tail_index_ = 0;
+    if (count_.exchange(0) >= max_size_.load()) {
+      not_full_.notify_all();
+    }
+  }
+
+  size_t Size() {
+    return count_.load();
+  }
+
+  bool Empty() {
+    return count_.load() == 0;
+  }
+ private:
+  struct Segment {
+    T *slot(size_t i) {
+      return reinterpret_cast<T *>(storage_) + i;
+    }
+
+    Segment *next_ = nullptr;
+    alignas(T) unsigned char storage_[kSegmentSize * sizeof(T)];
+  };
+
+  template<typename... Args>
+  bool TryEmplaceBack(Args &&... args) {
+    size_t c;
+    {
+      std::lock_guard<std::mutex> locker(tail_mutex_);
+      if (count_.load() >= max_size_.load()) {
+        return false;
+      }
+      c = Enqueue(std::forward<Args>(args)...);
+    }
+    if (c == 0) {
+      SignalNotEmpty();
+    }
+    return true;
+  }
+
+  //Called with tail_mutex_ held and room in the queue, returns the count before
+  template<typename... Args>
+  size_t Enqueue(Args &&... args) {
+    if (tail_index_ == kSegmentSize) {
+      Segment *segment = PopSpare();
+      if (segment == nullptr) {
+        segment = new Segment;
+      }
+      segment->next_ = nullptr;
+      //Linked before any item in it is counted, see Advance()
+      tail_->next_ = segment;
+      tail_ = segment;
+      tail_index_ = 0;
+    }
+    new (tail_->slot(tail_index_)) T(std::forward<Args>(args)...);
+    ++tail_index_;
+    //Publishes the item and tail_->next_ to the consumer that observes the new count
+    size_t c = count_.fetch_add(1);
+    if (c + 1 < max_size_.load()) {
+      not_full_.notify_one();
+    }
+    return c;
+  }
+
+  //Called with head_mutex_ held and count_ > 0. Steps onto the next segment when
+  //the current one is drained and returns the drained one, or nullptr
+  Segment *Advance() {
+    if (head_index_ < kSegmentSize) {
+      return nullptr;
+    }
+    Segment *drained = head_;
+    head_ = head_->next_;
+    head_index_ = 0;
+    return drained;
+  }
+
+  T *Front() {
+    return head_->slot(head_index_);
+  }
+
+  //Called with head_mutex_ held after the front value was moved out,
+  //returns the count before
+  size_t Dequeue() {
+    Front()->~T();
+    ++head_index_;
+    size_t c = count_.fetch_sub(1);
+    if (c > 1) {
+      not_empty_.notify_one();
+    }
+    return c;
+  }
+
+  void Release(std::unique_lock<std::mutex> *locker, Segment *drained, size_t c) {
+    locker->unlock();
+    if (drained != nullptr) {
+      PushSpare(drained);
+    }
+    if (c >= max_size_.load()) {
+      SignalNotFull();
+    }
+  }
+
+  //Spares form a Treiber stack. Only producers pop, serialized by tail_mutex_ (or
+  //the destructor), and a segment is pushed again only after it was popped, so
+  //the single popper cannot see ABA
+  void PushSpare(Segment *segment) {
+    if (spare_count_.fetch_add(1) >= kMaxSpares) {
+      spare_count_.fetch_sub(1);
+      delete segment;
+      return;
+    }
+    segment->next_ = spares_.load();
+    while (!spares_.compare_exchange_weak(segment->next_, segment)) {
+    }
+  }
+
+  Segment *PopSpare() {
+    Segment *segment = spares_.load();
+    while (segment != nullptr && !spares_.compare_exchange_weak(segment, segment->next_)) {
+    }
+    if (segment != nullptr) {
+      spare_count_.fetch_sub(1);
+    }
+    return segment;
+  }
+
+  void SignalNotEmpty() {
+    std::lock_guard<std::mutex> locker(head_mutex_);
+    not_empty_.notify_one();
+  }
+
+  void SignalNotFull() {
+    std::lock_guard<std::mutex> locker(tail_mutex_);
+    not_full_.notify_one();
+  }
+
+  //Consumer side
+  std::mutex head_mutex_;
+  std::condition_variable not_empty_;
+  Segment *head_;
+  size_t head_index_ = 0;
+  char head_pad_[64];
+
+  //Producer side
+  std::mutex tail_mutex_;
+  std::condition_variable not_full_;
+  Segment *tail_;
+  size_t tail_index_ = 0;
+  char tail_pad_[64];
+
+  std::atomic<size_t> count_{0};
+  std::atomic<uint32_t> max_size_{std::numeric_limits<std::uint32_t>::max()};
+  std::atomic<Segment *> spares_{nullptr};
+  std::atomic<size_t> spare_count_{0};
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif // SIMPLELIB_TWO_LOCK_BLOCKING_QUEUE_HPP_
@@ -0,0 +1,234 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "two_lock_blocking_queue.hpp"
+
+using namespace simplelib;
+
+//Counts live instances, so leaked or doubly destroyed items show up
+struct Tracked {
+    static std::atomic<int> live;
+
+    Tracked() : _v(-1) {
+        live++;
+    }
+
+    explicit Tracked(int v) : _v(v) {
+        live++;
+    }
+
+    Tracked(const Tracked &other) : _v(other._v) {
+        live++;
+    }
+
+    Tracked &operator=(const Tracked &other) = default;
+
+    ~Tracked() {
+        live--;
+    }
+
+    int _v;
+};
+
+std::atomic<int> Tracked::live(0);
+
+TEST(TwoLockBlockingQueueTest, Test_Fifo_Across_Segments) {
+    {
+        TwoLockBlockingQueue<Tracked> queue;
+        const int n = static_cast<int>(TwoLockBlockingQueue<Tracked>::kSegmentSize) * 5 + 7;
+        int next_in = 0;
+        int next_out = 0;
+        //Keep the queue a few segments long while both ends walk through segments
+        for (int round = 0; round < 10; round++) {
+            for (int i = 0; i < n; i++) {
+                queue.PushBack(Tracked(next_in++));
+            }
+            ASSERT_EQ(static_cast<size_t>(n * (round + 1) - next_out), queue.Size());
+            for (int i = 0; i < n - 10; i++) {
+                Tracked t;
+                queue.PopFront(&t);
+                ASSERT_EQ(next_out++, t._v);
+            }
+        }
+        while (!queue.Empty()) {
+            ASSERT_EQ(next_out++, queue.PopFront()._v);
+        }
+        ASSERT_EQ(next_in, next_out);
+
+        //Items still queued are destroyed with the queue
+        for (int i = 0; i < 200; i++) {
+            queue.PushBack(Tracked(i));
+        }
+    }
+    ASSERT_EQ(0, Tracked::live.load());
+}
+
+TEST(TwoLockBlockingQueueTest, Test_Clear_Reuse) {
+    TwoLockBlockingQueue<Tracked> queue;
+    for (int i = 0; i < 100; i++) {
+        queue.PushBack(Tracked(i));
+    }
+    //Leave the head in the middle of the second segment
+    for (int i = 0; i < 70; i++) {
+        ASSERT_EQ(i, queue.PopFront()._v);
+    }
+    queue.Clear();
+    ASSERT_TRUE(queue.Empty());
+    ASSERT_EQ(0, Tracked::live.load());
+    Tracked t;
+    ASSERT_FALSE(queue.TryPopFront(&t));
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 300; i++) {
+            ASSERT_TRUE(queue.TryPushBack(Tracked(i)));
+        }
+        for (int i = 0; i < 300; i++) {
+            ASSERT_TRUE(queue.TryPopFront(&t));
+            ASSERT_EQ(i, t._v);
+        }
+        ASSERT_TRUE(queue.Empty());
+    }
+    queue.Clear();
+    ASSERT_EQ(1, Tracked::live.load());
+}
+
+TEST(TwoLockBlockingQueueTest, Test_Max_Size) {
+    TwoLockBlockingQueue<int> queue(2);
+    queue.PushBack(0);
+    queue.PushBack(1);
+    ASSERT_FALSE(queue.TryPushBack(2));
+
+    //A blocked producer is released by a pop
+    std::atomic<int> pushed(0);
+    std::thread producer([&queue, &pushed]() {
+        queue.PushBack(2);
+        pushed++;
+        queue.PushBack(3);
+        pushed++;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(0, pushed.load());
+    ASSERT_EQ(0, queue.PopFront());
+    while (pushed.load() == 0) {
+        std::this_thread::yield();
+    }
+
+    //and by raising the bound
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(1, pushed.load());
+    ASSERT_EQ(2, queue.Size());
+    queue.SetMaxSize(3);
+    producer.join();
+    ASSERT_EQ(3, queue.Size());
+    for (int i = 1; i < 4; i++) {
+        ASSERT_EQ(i, queue.PopFront());
+    }
+
+    //Clear releases a producer blocked on a full queue
+    queue.SetMaxSize(1);
+    queue.PushBack(4);
+    std::thread blocked([&queue]() {
+        queue.PushBack(5);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.Clear();
+    blocked.join();
+    ASSERT_EQ(5, queue.PopFront());
+}
+
+TEST(TwoLockBlockingQueueTest, Test_Timeout) {
+    TwoLockBlockingQueue<std::string> queue(1);
+    std::string s;
+    auto begin = std::chrono::steady_clock::now();
+    ASSERT_FALSE(queue.PopFrontWithTimeout(&s, 20));
+    ASSERT_GE(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(20));
+
+    ASSERT_TRUE(queue.PushBackWithTimeout(std::string("a"), 0));
+    begin = std::chrono::steady_clock::now();
+    ASSERT_FALSE(queue.PushBackWithTimeout(std::string("b"), 20));
+    ASSERT_GE(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(20));
+
+    //A waiting pop gets an item pushed meanwhile
+    std::thread producer([&queue]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        queue.PushBack(std::string("c"));
+    });
+    ASSERT_TRUE(queue.PopFrontWithTimeout(&s, 10000));
+    ASSERT_EQ("a", s);
+    ASSERT_TRUE(queue.PopFrontWithTimeout(&s, 10000));
+    ASSERT_EQ("c", s);
+    producer.join();
+}
+
+TEST(TwoLockBlockingQueueTest, Test_Mpmc_Stress) {
+    //Every item arrives exactly once, and each consumer sees the items of a
+    //producer in push order
+    const int producers = 4;
+    const int consumers = 4;
+    const int per_producer = 50000;
+    TwoLockBlockingQueue<int> queue(100);
+    std::vector<std::atomic<int>> seen(producers * per_producer);
+    for (auto &s : seen) {
+        s = 0;
+    }
+    std::atomic<int> errors(0);
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&]() {
+            std::vector<int> last(producers, -1);
+            int t;
+            while (true) {
+                queue.PopFront(&t);
+                if (t < 0) {
+                    break;
+                }
+                int p = t / per_producer;
+                if (t <= last[p]) {
+                    errors++;
+                }
+                last[p] = t;
+                seen[t]++;
+            }
+        });
+    }
+    std::vector<std::thread> pushers;
+    for (int p = 0; p < producers; p++) {
+        pushers.emplace_back([&queue, p, per_producer]() {
+            for (int i = 0; i < per_producer; i++) {
+                if (i % 3 == 0) {
+                    while (!queue.TryPushBack(p * per_producer + i)) {
+                        std::this_thread::yield();
+                    }
+                } else {
+                    queue.PushBack(p * per_producer + i);
+                }
+            }
+        });
+    }
+    for (auto &pusher : pushers) {
+        pusher.join();
+    }
+    for (int c = 0; c < consumers; c++) {
+        queue.PushBack(-1);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(0, errors.load());
+    for (size_t i = 0; i < seen.size(); i++) {
+        ASSERT_EQ(1, seen[i].load());
+    }
+    ASSERT_TRUE(queue.Empty());
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    // Runs all tests using Google Test.
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,143 @@
+#ifndef SIMPLELIB_WORK_STEALING_DEQUE_HPP_
+#define SIMPLELIB_WORK_STEALING_DEQUE_HPP_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include "common.h"
+
+BEGIN_NAMESPACE_SIMPLELIB
+
+// Chase-Lev work-stealing deque (Chase & Lev, SPAA'05, with the C11 orderings of
+// Le et al., PPoPP'13):
+// 1. One owner thread pushes and pops at the bottom, uncontended except when
+//    racing a thief for the last item
+// 2. Any number of thieves steal from the top with one CAS
+// 3. The ring grows by doubling. A thief may still be reading the old ring,
+//    so retired rings are kept until the deque is destroyed; together they
+//    are never larger than the current one.
+//
+// T is copied in and out of atomic slots, so it must be trivially copyable
+// (typically a task pointer or index).
+template<typename T>
+class WorkStealingDeque {
+  static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+ public:
+  explicit WorkStealingDeque(size_t capacity = 1024) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    rings_.emplace_back(new Ring(size));
+    ring_.store(rings_.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque &) = delete;
+  WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+  // Owner only
+  void PushBottom(const T &t) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    Ring *ring = ring_.load(std::memory_order_relaxed);
+    if (b - top > ring->mask_) {
+      ring = Grow(ring, top, b);
+    }
+    ring->Put(b, t);
+    // Publishes the slot to thieves that read the new bottom
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  // Owner only, LIFO end. Returns false if the deque is empty.
+  bool PopBottom(T *t) {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Ring *ring = ring_.load(std::memory_order_relaxed);
+    // Reserve the bottom slot before looking at top, pairs with Steal()
+    bottom_.store(b, std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_seq_cst);
+    if (top > b) {
+      // Empty, undo the reservation
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    (*t) = ring->Get(b);
+    if (top == b) {
+      // Last item, race the thieves for it
+      bool won = top_.compare_exchange_strong(top, top + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed);
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Any thread, FIFO end. Returns false if the deque looked empty or another
+  // thread won the race for the top item; callers usually move on to another
+  // victim either way.
+  bool Steal(T *t) {
+    int64_t top = top_.load(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_seq_cst);
+    if (top >= b) {
+      return false;
+    }
+    Ring *ring = ring_.load(std::memory_order_acquire);
+    T value = ring->Get(top);
+    if (!top_.compare_exchange_strong(top, top + 1,
+                                      std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return false;
+    }
+    (*t) = value;
+    return true;
+  }
+
+  // Approximate while other threads are running
+  int64_t Size() {
+    int64_t size = bottom_.load(std::memory_order_relaxed) - top_.load(std::memory_order_relaxed);
+    return size > 0 ? size : 0;
+  }
+
+  bool Empty() {
+    return Size() == 0;
+  }
+
+ private:
+  struct Ring {
+    explicit Ring(size_t size) : mask_(static_cast<int64_t>(size) - 1), slots_(new std::atomic<T>[size]) {}
+
+    T Get(int64_t i) {
+      return slots_[i & mask_].load(std::memory_order_relaxed);
+    }
+
+    void Put(int64_t i, const T &t) {
+      slots_[i & mask_].store(t, std::memory_order_relaxed);
+    }
+
+    int64_t mask_;
+    std::unique_ptr<std::atomic<T>[]> slots_;
+  };
+
+  // Owner only, copies the live range [top, bottom) into a ring twice as large
+  Ring *Grow(Ring *ring, int64_t top, int64_t bottom) {
+    rings_.emplace_back(new Ring(static_cast<size_t>(ring->mask_ + 1) * 2));
+    Ring *grown = rings_.back().get();
+    for (int64_t i = top; i < bottom; i++) {
+      grown->Put(i, ring->Get(i));
+    }
+    ring_.store(grown, std::memory_order_release);
+    return grown;
+  }
+
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Ring *> ring_{nullptr};
+  // Owner only: every ring ever used, the current one last
+  std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+END_NAMESPACE_SIMPLELIB
+
+#endif // SIMPLELIB_WORK_STEALING_DEQUE_HPP_
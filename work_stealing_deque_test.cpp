@@ -0,0 +1,172 @@
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "work_stealing_deque.hpp"
+
+using namespace simplelib;
+
+TEST(WorkStealingDequeTest, Test_Order) {
+    WorkStealingDeque<int> deque(4);
+    int t = -1;
+    ASSERT_FALSE(deque.PopBottom(&t));
+    ASSERT_FALSE(deque.Steal(&t));
+    ASSERT_TRUE(deque.Empty());
+
+    for (int i = 0; i < 10; i++) {
+        deque.PushBottom(i);
+    }
+    ASSERT_EQ(10, deque.Size());
+    //Owner is LIFO, thieves are FIFO
+    ASSERT_TRUE(deque.PopBottom(&t));
+    ASSERT_EQ(9, t);
+    ASSERT_TRUE(deque.Steal(&t));
+    ASSERT_EQ(0, t);
+    ASSERT_TRUE(deque.Steal(&t));
+    ASSERT_EQ(1, t);
+    ASSERT_TRUE(deque.PopBottom(&t));
+    ASSERT_EQ(8, t);
+    for (int i = 7; i >= 2; i--) {
+        ASSERT_TRUE(deque.PopBottom(&t));
+        ASSERT_EQ(i, t);
+    }
+    ASSERT_FALSE(deque.PopBottom(&t));
+    ASSERT_FALSE(deque.Steal(&t));
+    ASSERT_TRUE(deque.Empty());
+
+    //Still usable after running dry
+    deque.PushBottom(42);
+    ASSERT_TRUE(deque.Steal(&t));
+    ASSERT_EQ(42, t);
+    ASSERT_FALSE(deque.PopBottom(&t));
+}
+
+//Thieves steal until stop is set and the deque is drained
+static void StealAll(WorkStealingDeque<int> *deque, std::atomic<bool> *stop,
+                     std::vector<std::atomic<int>> *seen) {
+    int t = -1;
+    while (true) {
+        if (deque->Steal(&t)) {
+            (*seen)[t]++;
+        } else if (stop->load() && deque->Empty()) {
+            break;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+TEST(WorkStealingDequeTest, Test_Grow_With_Thieves) {
+    const int n = 100000;
+    WorkStealingDeque<int> deque(2);
+    std::vector<std::atomic<int>> seen(n);
+    for (auto &s : seen) {
+        s = 0;
+    }
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < 3; i++) {
+        thieves.emplace_back(StealAll, &deque, &stop, &seen);
+    }
+    //Bursts larger than the ring make the owner grow it while thieves read
+    int next = 0;
+    int t = -1;
+    while (next < n) {
+        for (int i = 0; i < 1000 && next < n; i++) {
+            deque.PushBottom(next++);
+        }
+        for (int i = 0; i < 100 && deque.PopBottom(&t); i++) {
+            seen[t]++;
+        }
+    }
+    while (deque.PopBottom(&t)) {
+        seen[t]++;
+    }
+    stop = true;
+    for (auto &thief : thieves) {
+        thief.join();
+    }
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(1, seen[i].load()) << i;
+    }
+}
+
+TEST(WorkStealingDequeTest, Test_Stress) {
+    const int n = 200000;
+    WorkStealingDeque<int> deque(16);
+    std::vector<std::atomic<int>> seen(n);
+    for (auto &s : seen) {
+        s = 0;
+    }
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < 4; i++) {
+        thieves.emplace_back(StealAll, &deque, &stop, &seen);
+    }
+    std::mt19937 rng(1);
+    int next = 0;
+    int t = -1;
+    while (next < n) {
+        if (rng() % 3 != 0) {
+            deque.PushBottom(next++);
+        } else if (deque.PopBottom(&t)) {
+            seen[t]++;
+        }
+    }
+    while (deque.PopBottom(&t)) {
+        seen[t]++;
+    }
+    stop = true;
+    for (auto &thief : thieves) {
+        thief.join();
+    }
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(1, seen[i].load()) << i;
+    }
+}
+
+//Owner and one thief go for a single item at once, exactly one may get it
+TEST(WorkStealingDequeTest, Test_Last_Item_Race) {
+    const int rounds = 20000;
+    WorkStealingDeque<int> deque(2);
+    std::atomic<int> go(-1);
+    std::atomic<int> done(-1);
+    std::atomic<int> thief_wins(0);
+    std::thread thief([&]() {
+        for (int r = 0; r < rounds; r++) {
+            while (go.load() != r) {
+                std::this_thread::yield();
+            }
+            int t = -1;
+            if (deque.Steal(&t)) {
+                EXPECT_EQ(r, t);
+                thief_wins++;
+            }
+            done = r;
+        }
+    });
+    int owner_wins = 0;
+    for (int r = 0; r < rounds; r++) {
+        deque.PushBottom(r);
+        go = r;
+        int t = -1;
+        if (deque.PopBottom(&t)) {
+            ASSERT_EQ(r, t);
+            owner_wins++;
+        }
+        while (done.load() != r) {
+            std::this_thread::yield();
+        }
+        ASSERT_EQ(r + 1, owner_wins + thief_wins.load());
+        ASSERT_TRUE(deque.Empty());
+    }
+    thief.join();
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+
+    // Runs all tests using Google Test.
+    return RUN_ALL_TESTS();
+}